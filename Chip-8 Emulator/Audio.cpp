@@ -0,0 +1,226 @@
+#include "Audio.hpp"
+#include <cstring>
+
+namespace
+{
+	// Little-endian fields of the WAV header, whatever the host
+	void PutLittleEndian(std::ofstream& file, uint32_t value, int bytes)
+	{
+		for (int i = 0; i < bytes; ++i)
+		{
+			file.put(static_cast<char>((value >> (8 * i)) & 0xFFu));
+		}
+	}
+}
+
+SoundEventRing::SoundEventRing(size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	ring.resize(size);
+	mask = size - 1;
+}
+
+void SoundFeed::Update(Chip8 const& chip8)
+{
+	Scheduler const& scheduler = chip8.GetScheduler();
+
+	SoundEvent event{};
+	event.cycle = scheduler.Cycles();
+	event.clockHz = scheduler.ClockHz();
+	event.on = chip8.SoundTimer() > 0;
+	event.usePattern = chip8.GetQuirks() == QuirkProfile::XoChip;
+	event.pitch = chip8.Pitch();
+	memcpy(event.pattern, chip8.AudioPattern(), AUDIO_PATTERN_SIZE);
+
+	// Published first, so the consumer never sees an event stamped past the clock it knows
+	ring.Publish(event.cycle);
+
+	bool rewound = event.cycle < last.cycle;
+	bool changed = event.on != last.on || event.clockHz != last.clockHz || event.usePattern != last.usePattern || event.pitch != last.pitch
+		|| memcmp(event.pattern, last.pattern, AUDIO_PATTERN_SIZE) != 0;
+
+	if (!started || rewound || changed)
+	{
+		ring.Push(event);
+	}
+
+	last = event;
+	started = true;
+}
+
+SoundSynth::SoundSynth(SoundEventRing& ring, unsigned int sampleRate)
+	: ring(ring), sampleRate(sampleRate > 0 ? sampleRate : AUDIO_SAMPLE_RATE)
+{
+	state.clockHz = DEFAULT_CLOCK_HZ;
+	state.pitch = DEFAULT_PITCH;
+	Apply(state);
+}
+
+void SoundSynth::Render(int16_t* samples, unsigned int count)
+{
+	double latest = static_cast<double>(ring.Latest());
+	double frameCycles = static_cast<double>(state.clockHz) / TIMER_HZ;
+
+	// Never ahead of the emulation, and at most a couple of frames behind it
+	if (cursor > latest)
+	{
+		cursor = latest;
+	}
+	else if (latest - cursor > MAX_LAG_FRAMES * frameCycles)
+	{
+		cursor = latest - frameCycles;
+	}
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		for (SoundEvent const* event = ring.Peek(); event; event = ring.Peek())
+		{
+			if (event->cycle > cursor)
+			{
+				// Not due yet, unless it is past the clock: left over from before a rewind
+				if (event->cycle <= latest)
+				{
+					break;
+				}
+
+				latest = static_cast<double>(ring.Latest());
+				if (event->cycle <= latest)
+				{
+					break;
+				}
+			}
+
+			Apply(*event);
+			ring.Pop();
+		}
+
+		int16_t sample = 0;
+
+		if (state.on)
+		{
+			bool high;
+			if (state.usePattern)
+			{
+				unsigned int bit = static_cast<unsigned int>(phase);
+				high = (state.pattern[bit / 8] >> (7 - bit % 8)) & 1;
+			}
+			else
+			{
+				high = phase < 0.5;
+			}
+
+			sample = high ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+
+			phase += increment;
+			if (phase >= period)
+			{
+				phase -= period;
+			}
+		}
+
+		samples[i] = sample;
+
+		// Hold at the published clock when the emulation is late
+		cursor = cursor + cyclesPerSample < latest ? cursor + cyclesPerSample : latest;
+	}
+}
+
+void SoundSynth::Apply(SoundEvent const& event)
+{
+	// Each beep starts at the beginning of its wave or pattern
+	if (event.on && !state.on)
+	{
+		phase = 0.0;
+	}
+
+	state = event;
+	if (state.clockHz == 0)
+	{
+		state.clockHz = DEFAULT_CLOCK_HZ;
+	}
+
+	cyclesPerSample = static_cast<double>(state.clockHz) / sampleRate;
+	period = state.usePattern ? AUDIO_PATTERN_SIZE * 8.0 : 1.0;
+	increment = (state.usePattern ? PatternRate(state.pitch) : BEEP_HZ) / sampleRate;
+	if (phase >= period)
+	{
+		phase = 0.0;
+	}
+}
+
+WavWriter::~WavWriter()
+{
+	Close();
+}
+
+bool WavWriter::Open(char const* filename, unsigned int sampleRate)
+{
+	Close();
+
+	file.open(filename, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	this->sampleRate = sampleRate;
+	dataBytes = 0;
+	WriteHeader(sampleRate);
+
+	return !file.fail();
+}
+
+void WavWriter::Write(int16_t const* samples, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		PutLittleEndian(file, static_cast<uint16_t>(samples[i]), 2);
+	}
+
+	dataBytes += static_cast<uint32_t>(count * sizeof(int16_t));
+}
+
+bool WavWriter::Close()
+{
+	if (!file.is_open())
+	{
+		return true;
+	}
+
+	// The sizes are only known now
+	file.seekp(0);
+	WriteHeader(sampleRate);
+
+	bool written = !file.fail();
+	file.close();
+
+	return written && !file.fail();
+}
+
+void WavWriter::WriteHeader(unsigned int sampleRate)
+{
+	const uint32_t channels = 1;
+	const uint32_t bitsPerSample = 16;
+
+	file.write("RIFF", 4);
+	PutLittleEndian(file, 36 + dataBytes, 4);
+	file.write("WAVE", 4);
+
+	file.write("fmt ", 4);
+	PutLittleEndian(file, 16, 4);// size of this chunk
+	PutLittleEndian(file, 1, 2);// PCM
+	PutLittleEndian(file, channels, 2);
+	PutLittleEndian(file, sampleRate, 4);
+	PutLittleEndian(file, sampleRate * channels * bitsPerSample / 8, 4);// bytes a second
+	PutLittleEndian(file, channels * bitsPerSample / 8, 2);// bytes a sample
+	PutLittleEndian(file, bitsPerSample, 2);
+
+	file.write("data", 4);
+	PutLittleEndian(file, dataBytes, 4);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include "Chip8.hpp"
+
+const unsigned int AUDIO_SAMPLE_RATE = 48000;
+const unsigned int AUDIO_BUFFER_SAMPLES = 256;// about 5 ms a device buffer at AUDIO_SAMPLE_RATE
+const double BEEP_HZ = 440.0;// square wave played while the sound timer runs, outside XO-CHIP
+const int16_t AUDIO_AMPLITUDE = 4096;
+
+// The sound the machine makes from cycle on, until the next event
+struct SoundEvent
+{
+	uint64_t cycle;// emulated cycle the sound changed at
+	uint32_t clockHz;// emulated clock rate from then on
+	uint8_t on;// the sound timer is running
+	uint8_t usePattern;// play pattern at pitch instead of the square wave (XO-CHIP)
+	uint8_t pitch;
+	uint8_t reserved;
+	uint8_t pattern[AUDIO_PATTERN_SIZE];
+};
+
+// Hands SoundEvents from the emulation thread to the audio thread without locks: a
+// single-producer single-consumer ring like TraceWriter's, plus the emulated cycle
+// the producer has reached, which the consumer's playback follows. Neither side
+// waits or allocates; if the audio thread stops draining the ring, events are
+// dropped and counted.
+class SoundEventRing
+{
+public:
+	// capacity is in events and rounded up to a power of two
+	explicit SoundEventRing(size_t capacity = 1024);
+
+	// Producer side, one thread only
+	bool Push(SoundEvent const& event)
+	{
+		size_t position = head.load(std::memory_order_relaxed);
+
+		if (position - cachedTail == ring.size())
+		{
+			cachedTail = tail.load(std::memory_order_acquire);
+
+			if (position - cachedTail == ring.size())
+			{
+				++dropped;
+				return false;
+			}
+		}
+
+		ring[position & mask] = event;
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// The emulated clock the producer has reached; call before pushing that cycle's event
+	void Publish(uint64_t cycle) { latest.store(cycle, std::memory_order_release); }
+	uint64_t Dropped() const { return dropped; }
+
+	// Consumer side, one thread only: the oldest event, or nullptr when there is none
+	SoundEvent const* Peek() const
+	{
+		size_t position = tail.load(std::memory_order_relaxed);
+		return position == head.load(std::memory_order_acquire) ? nullptr : &ring[position & mask];
+	}
+
+	void Pop() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+	uint64_t Latest() const { return latest.load(std::memory_order_acquire); }
+
+private:
+	std::vector<SoundEvent> ring;
+	size_t mask;
+	std::atomic<uint64_t> latest{0};
+
+	// Producer and consumer indices on their own cache lines so they don't bounce
+	alignas(64) std::atomic<size_t> head{0};
+	size_t cachedTail{};// producer's last view of tail
+	uint64_t dropped{};
+	alignas(64) std::atomic<size_t> tail{0};
+};
+
+// Emulation thread side: publishes the machine's clock and pushes an event whenever its
+// sound changes. Call Update after every batch the machine runs. A batch that starts
+// the sound timer ends there (EVENT_SOUND_START) and the timer only runs out on a tick,
+// where RunFrame ends, so both are stamped with their exact cycle; only Fx18 with zero
+// is stamped at the end of its batch. A clock that went backwards (a rewind or a loaded
+// snapshot) pushes the sound as it now is.
+class SoundFeed
+{
+public:
+	explicit SoundFeed(SoundEventRing& ring) : ring(ring) {}
+
+	void Update(Chip8 const& chip8);
+
+private:
+	SoundEventRing& ring;
+	SoundEvent last{};
+	bool started{};
+};
+
+// Audio thread side: plays the events as 16-bit mono samples, a square wave at BEEP_HZ
+// or the XO-CHIP pattern while the sound timer runs and silence otherwise. Playback
+// runs through emulated time at the sample rate but never gets ahead of the clock the
+// producer published, and is moved up when it falls more than MAX_LAG_FRAMES behind,
+// so the sound stays within a frame of the emulation whichever clock drifts. Render
+// neither locks nor allocates.
+class SoundSynth
+{
+public:
+	static const unsigned int MAX_LAG_FRAMES = 2;
+
+	SoundSynth(SoundEventRing& ring, unsigned int sampleRate);
+
+	void Render(int16_t* samples, unsigned int count);
+
+private:
+	void Apply(SoundEvent const& event);
+
+	SoundEventRing& ring;
+	unsigned int sampleRate;
+	SoundEvent state{};
+	double cursor{};// emulated cycle being played
+	double cyclesPerSample{};
+	double phase{};// square wave periods or pattern bits played, wrapping at period
+	double increment{};// phase per sample
+	double period{1.0};
+};
+
+// 16-bit mono PCM WAV file, for listening to what a headless run played
+class WavWriter
+{
+public:
+	~WavWriter();
+
+	bool Open(char const* filename, unsigned int sampleRate);
+	void Write(int16_t const* samples, size_t count);
+	// Fills in the header's sizes and closes the file; false if a write failed
+	bool Close();
+
+	uint64_t Samples() const { return dataBytes / sizeof(int16_t); }
+
+private:
+	void WriteHeader(unsigned int sampleRate);
+
+	std::ofstream file;
+	unsigned int sampleRate{};
+	uint32_t dataBytes{};
+};
@@ -0,0 +1,282 @@
+#include "Chip8.hpp"
+#include "NullPlatform.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+#include "Video.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One ROM/input-script combination. The machine only exists while the job runs,
+// so thousands of queued jobs cost no more than their descriptions.
+struct Job
+{
+	std::string rom;
+	uint64_t cycles;
+	std::string script;
+	bool seeded{};// the job file gave a seed, overriding --seed
+	uint64_t seed{};
+
+	std::unique_ptr<Chip8> chip8;
+	NullPlatform platform;
+
+	// Results, filled in when the job finishes
+	std::string failure;// why the job could not start, empty if it ran
+	uint64_t seedUsed{};
+	uint64_t cyclesRun{};
+	uint64_t idleCycles{};// of cyclesRun, fast-forwarded through idle loops
+	uint64_t frames{};
+	uint16_t pc{};
+	uint16_t index{};
+	uint8_t registers[REGISTER_COUNT]{};
+	uint64_t frameHash{};
+};
+
+// Settings shared by every job
+struct BatchOptions
+{
+	Backend backend{Backend::Table};
+	uint32_t clockHz{DEFAULT_CLOCK_HZ};
+	uint64_t chunk{100000};
+	bool idleSkip{true};
+	QuirkProfile quirks{QuirkProfile::Default};
+	RandomSource randomSource{RandomSource::Pcg};
+	bool seeded{};// otherwise each job keeps the clock seed its machine started with
+	uint64_t seed{};
+};
+
+// Job file lines are "<ROM> <Cycles> [<InputScript>|-] [<Seed>]"; blank lines and # comments are skipped
+bool LoadJobs(char const* filename, std::vector<Job>& jobs)
+{
+	std::ifstream file(filename);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string rom;
+
+		if (!(fields >> rom) || rom[0] == '#')
+		{
+			continue;
+		}
+
+		jobs.emplace_back();
+		Job& job = jobs.back();
+		job.rom = rom;
+
+		if (!(fields >> job.cycles) || job.cycles == 0)
+		{
+			return false;
+		}
+
+		if (fields >> job.script && job.script == "-")
+		{
+			job.script.clear();
+		}
+
+		std::string seed;
+		if (fields >> seed)
+		{
+			char* end;
+			job.seed = std::strtoull(seed.c_str(), &end, 0);
+			job.seeded = true;
+
+			if (*end != '\0')
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Runs whole frames of the job until about chunk more cycles have run, then either
+// records the results or queues the next chunk
+void RunChunk(ThreadPool& pool, Job& job, BatchOptions const& options)
+{
+	if (!job.chip8)
+	{
+		job.chip8.reset(new Chip8(options.backend));
+		job.chip8->SetQuirks(options.quirks);
+		job.chip8->SetClockHz(options.clockHz);
+		job.chip8->SetIdleSkip(options.idleSkip);
+		job.chip8->SetRandom(options.randomSource, job.seeded ? job.seed : options.seeded ? options.seed : job.chip8->Seed());
+		job.seedUsed = job.chip8->Seed();
+
+		if (!job.chip8->LoadROM(job.rom.c_str()))
+		{
+			job.failure = "cannot read ROM " + job.rom;
+		}
+		else if (!job.script.empty() && !job.platform.LoadScript(job.script.c_str()))
+		{
+			job.failure = "cannot read input script " + job.script;
+		}
+
+		if (!job.failure.empty())
+		{
+			job.chip8.reset();
+			return;
+		}
+	}
+
+	Chip8& chip8 = *job.chip8;
+	Scheduler const& scheduler = chip8.GetScheduler();
+	uint64_t chunkEnd = scheduler.Cycles() + options.chunk;
+
+	while (scheduler.Cycles() < chunkEnd && scheduler.Cycles() < job.cycles)
+	{
+		job.platform.RunFrame(chip8, job.cycles);
+	}
+
+	if (scheduler.Cycles() < job.cycles)
+	{
+		pool.Submit([&pool, &job, &options] { RunChunk(pool, job, options); });
+		return;
+	}
+
+	job.cyclesRun = scheduler.Cycles();
+	job.idleCycles = chip8.IdleCycles();
+	job.frames = job.platform.Frame();
+	job.pc = chip8.PC();
+	job.index = chip8.Index();
+	for (unsigned int i = 0; i < REGISTER_COUNT; ++i)
+	{
+		job.registers[i] = chip8.Registers()[i];
+	}
+	job.frameHash = FRAME_HASH_SEED;
+	for (unsigned int plane = 0; plane < chip8.VideoPlanes(); ++plane)
+	{
+		job.frameHash = HashFrame(chip8.video[plane], chip8.VideoWords(), job.frameHash);
+	}
+
+	job.chip8.reset();
+}
+
+int main(int argc, char** argv)
+{
+	char const* jobFilename = nullptr;
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	BatchOptions options;
+	bool usage = false;
+
+	for (int i = 1; i < argc && !usage; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--threads" && hasValue)
+		{
+			threadCount = std::stoul(argv[++i]);
+		}
+		else if (arg == "--chunk" && hasValue)
+		{
+			options.chunk = std::stoull(argv[++i]);
+		}
+		else if (arg == "--clock" && hasValue)
+		{
+			options.clockHz = std::stoul(argv[++i]);
+		}
+		else if (arg == "--backend" && hasValue)
+		{
+			std::string name = argv[++i];
+			options.backend = name == "switch" ? Backend::Switch : name == "jit" ? Backend::Jit : Backend::Table;
+			usage = name != "table" && name != "switch" && name != "jit";
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			options.seed = std::stoull(argv[++i]);
+			options.seeded = true;
+		}
+		else if (arg == "--rng" && hasValue)
+		{
+			usage = !ParseRandomSource(argv[++i], options.randomSource);
+		}
+		else if (arg == "--quirks" && hasValue)
+		{
+			usage = !ParseQuirkProfile(argv[++i], options.quirks);
+		}
+		else if (arg == "--no-idle-skip")
+		{
+			options.idleSkip = false;
+		}
+		else if (!jobFilename && arg[0] != '-')
+		{
+			jobFilename = argv[i];
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	if (usage || !jobFilename || options.chunk == 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " <JobFile> [--threads <N>] [--chunk <Cycles>] [--clock <Hz>] [--backend table|switch|jit]"
+			<< " [--seed <N>] [--rng pcg|xorshift|minstd] [--quirks default|vip|chip48|schip|xochip] [--no-idle-skip]\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	std::vector<Job> jobs;
+	if (!LoadJobs(jobFilename, jobs))
+	{
+		std::cerr << "Cannot read job file " << jobFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ThreadPool pool(threadCount);
+	for (Job& job : jobs)
+	{
+		pool.Submit([&pool, &job, &options] { RunChunk(pool, job, options); });
+	}
+	pool.Wait();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	uint64_t totalCycles = 0;
+	uint64_t idleCycles = 0;
+
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		Job const& job = jobs[i];
+		std::cout << "job " << i << " rom " << job.rom;
+
+		if (!job.failure.empty())
+		{
+			std::cout << " failed: " << job.failure << "\n";
+			continue;
+		}
+
+		std::cout << " seed " << job.seedUsed << " cycles " << job.cyclesRun << " frames " << job.frames << std::hex << std::setfill('0')
+			<< " pc " << std::setw(4) << job.pc << " i " << std::setw(4) << job.index << " v";
+		for (unsigned int r = 0; r < REGISTER_COUNT; ++r)
+		{
+			std::cout << " " << std::setw(2) << unsigned(job.registers[r]);
+		}
+		std::cout << " hash " << std::setw(16) << job.frameHash << std::dec << std::setfill(' ') << "\n";
+
+		totalCycles += job.cyclesRun;
+		idleCycles += job.idleCycles;
+	}
+
+	std::cout << "jobs " << jobs.size() << " threads " << pool.Size() << " steals " << pool.Steals() << " cycles " << totalCycles
+		<< " idle_cycles " << idleCycles << " wall_ms " << seconds * 1000.0 << " mips " << totalCycles / seconds / 1e6 << "\n";
+
+	return 0;
+}
@@ -0,0 +1,611 @@
+#include "Audio.hpp"
+#include "Chip8.hpp"
+#include "VectorMachine.hpp"
+#include "Video.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(CHIP8_BENCH_PLATFORM)
+#include "Platform.hpp"
+#endif
+
+// Benchmark suite. Every benchmark runs once to warm up and then reps times, and
+// prints one CSV line: name, unit, repetitions, mean, sample standard deviation,
+// min and max. Names are stable so results from two builds can be joined on them.
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Options
+	{
+		unsigned int reps{5};
+		unsigned int cycles{2000000};// instructions per interpreter sample
+		std::string filter;// only benchmarks whose name contains this
+	};
+
+	Options options;
+
+	double Seconds(Clock::time_point start, Clock::time_point end)
+	{
+		return std::chrono::duration<double>(end - start).count();
+	}
+
+	// Runs sample options.reps times after a warm-up and prints the statistics of what it returned
+	void Measure(std::string const& name, char const* unit, std::function<double()> const& sample)
+	{
+		if (name.find(options.filter) == std::string::npos)
+		{
+			return;
+		}
+
+		sample();
+
+		double mean = 0.0;
+		double sumSquares = 0.0;// running sum of squared deviations (Welford)
+		double min = 0.0;
+		double max = 0.0;
+
+		for (unsigned int i = 1; i <= options.reps; ++i)
+		{
+			double value = sample();
+
+			double delta = value - mean;
+			mean += delta / i;
+			sumSquares += delta * (value - mean);
+
+			min = i == 1 || value < min ? value : min;
+			max = i == 1 || value > max ? value : max;
+		}
+
+		double stddev = options.reps > 1 ? std::sqrt(sumSquares / (options.reps - 1)) : 0.0;
+
+		std::cout << name << "," << unit << "," << options.reps << "," << mean << "," << stddev << "," << min << "," << max << "\n";
+	}
+
+	// Runs cycles instructions, resuming after every event, and returns the seconds taken
+	double TimeCycles(Chip8& chip8, unsigned int cycles)
+	{
+		auto start = Clock::now();
+		unsigned int executed = 0;
+		while (executed < cycles)
+		{
+			executed += chip8.RunCycles(cycles - executed).cycles;
+		}
+		auto end = Clock::now();
+
+		return Seconds(start, end);
+	}
+
+	// A program of setup instructions followed by body repeated to fill about a
+	// kilobyte, then a jump back to the first repetition, so the jump is a small
+	// share of what runs. Instructions are big-endian as in a ROM file.
+	std::vector<uint8_t> LoopProgram(std::vector<uint16_t> const& setup, std::vector<uint16_t> const& body)
+	{
+		const unsigned int loopBytes = 1024;
+
+		std::vector<uint16_t> words(setup);
+		uint16_t loopStart = static_cast<uint16_t>(START_ADDRESS + 2 * setup.size());
+
+		for (unsigned int i = 0; i < loopBytes / 2 / body.size(); ++i)
+		{
+			words.insert(words.end(), body.begin(), body.end());
+		}
+		words.push_back(0x1000 | loopStart);
+
+		std::vector<uint8_t> program;
+		for (uint16_t word : words)
+		{
+			program.push_back(static_cast<uint8_t>(word >> 8));
+			program.push_back(static_cast<uint8_t>(word & 0xFF));
+		}
+
+		return program;
+	}
+
+	// Millions of instructions per second running program on backend
+	double ProgramMips(Backend backend, std::vector<uint8_t> const& program)
+	{
+		Chip8 chip8(backend);
+		chip8.SetRandom(RandomSource::Pcg, 1);
+		chip8.LoadROM(program.data(), program.size());
+
+		return options.cycles / TimeCycles(chip8, options.cycles) / 1e6;
+	}
+
+	// Nanoseconds per instruction of a program made of one instruction repeated, on the table backend
+	double ProgramNanoseconds(std::vector<uint8_t> const& program)
+	{
+		// Draws and clears end the batch after every instruction, so fewer of them do
+		const unsigned int count = 200000;
+
+		Chip8 chip8;
+		chip8.LoadROM(program.data(), program.size());
+
+		return TimeCycles(chip8, count) / count * 1e9;
+	}
+
+	char const* BackendName(Backend backend)
+	{
+		switch (backend)
+		{
+			case Backend::Switch: return "switch";
+			case Backend::Jit: return "jit";
+			default: return "table";
+		}
+	}
+
+	char const* RandomSourceName(RandomSource source)
+	{
+		switch (source)
+		{
+			case RandomSource::Xorshift: return "xorshift";
+			case RandomSource::MinStd: return "minstd";
+			default: return "pcg";
+		}
+	}
+
+	const Backend BACKENDS[] = { Backend::Table, Backend::Switch, Backend::Jit };
+	const RandomSource RANDOM_SOURCES[] = { RandomSource::Pcg, RandomSource::Xorshift, RandomSource::MinStd };
+	const QuirkProfile QUIRK_PROFILES[] = { QuirkProfile::Vip, QuirkProfile::Chip48, QuirkProfile::Schip, QuirkProfile::XoChip };
+
+	// Throughput of each opcode class on its own; registers start at zero unless the setup loads them
+	void BenchOpcodeClasses()
+	{
+		struct OpcodeClass
+		{
+			char const* name;
+			std::vector<uint16_t> setup;
+			std::vector<uint16_t> body;
+		};
+
+		const OpcodeClass classes[] = {
+			{ "load_imm", {}, { 0x6012 } },// 6xkk
+			{ "add_imm", {}, { 0x7001 } },// 7xkk
+			{ "alu", { 0x6101 }, { 0x8014, 0x8012, 0x8013, 0x8015 } },// 8xy4 8xy2 8xy3 8xy5
+			{ "shift", { 0x6101 }, { 0x8016, 0x801E } },// 8xy6 8xyE
+			{ "skip", { 0x6101 }, { 0x30FF, 0x4000, 0x5010 } },// 3xkk 4xkk 5xy0, none taken
+			{ "jump", {}, {} },// 1nnn to the next instruction, built below
+			{ "call_ret", { 0x1204, 0x00EE }, { 0x2202 } },// 2nnn to a 00EE
+			{ "index", {}, { 0xA300, 0xF01E } },// Annn Fx1E
+			{ "font", {}, { 0xF029 } },// Fx29
+			{ "bcd", { 0xA800 }, { 0xF033 } },// Fx33
+			{ "store", { 0xA800 }, { 0xF355 } },// Fx55, four registers
+			{ "load_mem", { 0xA800 }, { 0xF365 } },// Fx65, four registers
+			{ "random", {}, { 0xC0FF } },// Cxkk
+			{ "timers", {}, { 0xF015, 0xF007 } },// Fx15 Fx07
+			{ "keys", {}, { 0xE09E, 0xE1A1, 0x0000 } },// Ex9E not taken, ExA1 taken over a 0nnn
+		};
+
+		for (OpcodeClass const& opcodeClass : classes)
+		{
+			std::vector<uint8_t> program;
+
+			if (std::string(opcodeClass.name) == "jump")
+			{
+				for (unsigned int address = START_ADDRESS; address < START_ADDRESS + 1024; address += 2)
+				{
+					unsigned int target = address + 2 < START_ADDRESS + 1024 ? address + 2 : START_ADDRESS;
+					program.push_back(static_cast<uint8_t>(0x10 | (target >> 8)));
+					program.push_back(static_cast<uint8_t>(target & 0xFF));
+				}
+			}
+			else
+			{
+				program = LoopProgram(opcodeClass.setup, opcodeClass.body);
+			}
+
+			for (Backend backend : BACKENDS)
+			{
+				Measure(std::string("op/") + opcodeClass.name + "/" + BackendName(backend), "MIPS",
+					[&] { return ProgramMips(backend, program); });
+			}
+		}
+	}
+
+	// Dxyn by sprite height and position: byte aligned, straddling two bytes,
+	// clipped at the right or bottom edge, and starting past the edge so it wraps
+	void BenchDraw()
+	{
+		struct Position
+		{
+			char const* name;
+			uint8_t x;
+			uint8_t y;
+		};
+
+		const Position positions[] = {
+			{ "aligned", 8, 0 },
+			{ "unaligned", 3, 0 },
+			{ "clip_right", 60, 0 },
+			{ "clip_bottom", 8, 28 },
+			{ "wrapped", 67, 33 },
+		};
+
+		for (uint8_t height : { 1, 5, 8, 15 })
+		{
+			for (Position const& position : positions)
+			{
+				// V0 = x, V1 = y, I = the font, which gives every row some pixels
+				std::vector<uint8_t> program = LoopProgram(
+					{ static_cast<uint16_t>(0x6000 | position.x), static_cast<uint16_t>(0x6100 | position.y), static_cast<uint16_t>(0xA000 | FONTSET_START_ADDRESS) },
+					{ static_cast<uint16_t>(0xD010 | height) });
+
+				Measure("draw/h" + std::to_string(height) + "/" + position.name, "ns/op", [&] { return ProgramNanoseconds(program); });
+			}
+		}
+
+		std::vector<uint8_t> clear = LoopProgram({}, { 0x00E0 });
+		Measure("clear", "ns/op", [&] { return ProgramNanoseconds(clear); });
+	}
+
+	// Whole ROMs on every backend, the lockstep vector machine, RNG choices, loading and snapshots.
+	// Idle loops are run instruction by instruction except in the idle_skip runs, so the
+	// other figures measure the interpreters rather than how long the ROM sits waiting.
+	void BenchROM(char const* romFilename)
+	{
+		std::string prefix = std::string("rom/") + romFilename + "/";
+
+		for (Backend backend : BACKENDS)
+		{
+			for (bool idleSkip : { false, true })
+			{
+				Measure(prefix + BackendName(backend) + (idleSkip ? "_idle_skip" : ""), "MIPS", [&]
+				{
+					Chip8 chip8(backend);
+					chip8.SetIdleSkip(idleSkip);
+					chip8.LoadROM(romFilename);
+					chip8.SetRandom(RandomSource::Pcg, 1);
+
+					return options.cycles / TimeCycles(chip8, options.cycles) / 1e6;
+				});
+			}
+		}
+
+		// Random-heavy ROMs spend much of their time in Cxkk, which the switch backend shows most plainly
+		for (RandomSource source : RANDOM_SOURCES)
+		{
+			Measure(prefix + "switch_rng_" + RandomSourceName(source), "MIPS", [&]
+			{
+				Chip8 chip8(Backend::Switch);
+				chip8.SetIdleSkip(false);
+				chip8.LoadROM(romFilename);
+				chip8.SetRandom(source, 1);
+
+				return options.cycles / TimeCycles(chip8, options.cycles) / 1e6;
+			});
+		}
+
+		// Every profile runs handlers compiled for its quirks, so each should match the default within noise
+		for (QuirkProfile profile : QUIRK_PROFILES)
+		{
+			for (Backend backend : { Backend::Table, Backend::Switch })
+			{
+				Measure(prefix + BackendName(backend) + "_quirks_" + QuirkProfileName(profile), "MIPS", [&]
+				{
+					Chip8 chip8(backend);
+					chip8.SetIdleSkip(false);
+					chip8.SetQuirks(profile);
+					chip8.LoadROM(romFilename);
+					chip8.SetRandom(RandomSource::Pcg, 1);
+
+					return options.cycles / TimeCycles(chip8, options.cycles) / 1e6;
+				});
+			}
+		}
+
+		// Lanes differ only by their random numbers here, so divergence comes from Cxkk alone
+		const unsigned int lanes = 256;
+		double divergent = 0.0;
+
+		Measure(prefix + "vector_x256", "lane-MIPS", [&]
+		{
+			VectorMachine machine(lanes);
+			machine.LoadROM(romFilename);
+
+			unsigned int cycles = options.cycles / lanes + 1;
+
+			auto start = Clock::now();
+			machine.RunCycles(cycles);
+			auto end = Clock::now();
+
+			VectorMachine::Stats stats = machine.GetStats();
+			divergent = 100.0 * stats.divergentSteps / stats.steps;
+
+			return double(cycles) * lanes / Seconds(start, end) / 1e6;
+		});
+
+		Measure(prefix + "vector_divergent", "%", [&] { return divergent; });
+
+		Measure(prefix + "load", "us/op", [&]
+		{
+			const int count = 1000;
+			Chip8 chip8;
+
+			auto start = Clock::now();
+			for (int i = 0; i < count; ++i)
+			{
+				chip8.LoadROM(romFilename);
+			}
+			auto end = Clock::now();
+
+			return Seconds(start, end) / count * 1e6;
+		});
+
+		// Snapshots saved and restored while branching from one state of the ROM
+		Chip8 chip8;
+		chip8.LoadROM(romFilename);
+		chip8.SetRandom(RandomSource::Pcg, 1);
+		chip8.RunCycles(10000);
+
+		MachineState state;
+		const int count = 100000;
+
+		Measure(prefix + "snapshot_save", "ns/op", [&]
+		{
+			auto start = Clock::now();
+			for (int i = 0; i < count; ++i)
+			{
+				chip8.Save(state);
+			}
+			auto end = Clock::now();
+
+			return Seconds(start, end) / count * 1e9;
+		});
+
+		Measure(prefix + "snapshot_load", "ns/op", [&]
+		{
+			auto start = Clock::now();
+			for (int i = 0; i < count; ++i)
+			{
+				chip8.Load(state);
+			}
+			auto end = Clock::now();
+
+			return Seconds(start, end) / count * 1e9;
+		});
+	}
+
+	// Random bytes per second from each generator on its own
+	void BenchRandom()
+	{
+		for (RandomSource source : RANDOM_SOURCES)
+		{
+			Measure(std::string("rng/") + RandomSourceName(source), "Mbytes/s", [&]
+			{
+				RandomByte random;
+				random.Seed(source, 1);
+
+				const int count = 20000000;
+				uint8_t sum = 0;
+
+				auto start = Clock::now();
+				for (int i = 0; i < count; ++i)
+				{
+					sum += random.Next();
+				}
+				auto end = Clock::now();
+
+				// Keep the loop from being optimized away
+				volatile uint8_t sink = sum;
+				(void)sink;
+
+				return count / Seconds(start, end) / 1e6;
+			});
+		}
+	}
+
+	// One audio device buffer rendered with the sound on, as the audio callback does, for
+	// the square wave and the XO-CHIP pattern; the callback must stay far below 5 ms
+	void BenchAudio()
+	{
+		for (bool usePattern : { false, true })
+		{
+			Measure(std::string("audio/") + (usePattern ? "pattern" : "square"), "ns/buffer", [&]
+			{
+				SoundEventRing ring;
+				SoundSynth synth(ring, AUDIO_SAMPLE_RATE);
+
+				SoundEvent event{};
+				event.clockHz = DEFAULT_CLOCK_HZ;
+				event.on = 1;
+				event.usePattern = usePattern;
+				event.pitch = DEFAULT_PITCH;
+				memset(event.pattern, 0xA5, sizeof(event.pattern));
+				ring.Push(event);
+
+				const int count = 20000;
+				int16_t samples[AUDIO_BUFFER_SAMPLES];
+				int32_t sum = 0;
+
+				auto start = Clock::now();
+				for (int i = 0; i < count; ++i)
+				{
+					// The emulation stays a frame ahead, as when it runs in real time
+					ring.Publish(uint64_t(i + 1) * DEFAULT_CLOCK_HZ * AUDIO_BUFFER_SAMPLES / AUDIO_SAMPLE_RATE + DEFAULT_CLOCK_HZ / TIMER_HZ);
+					synth.Render(samples, AUDIO_BUFFER_SAMPLES);
+					sum += samples[i % AUDIO_BUFFER_SAMPLES];
+				}
+				auto end = Clock::now();
+
+				// Keep the loop from being optimized away
+				volatile int32_t sink = sum;
+				(void)sink;
+
+				return Seconds(start, end) / count * 1e9;
+			});
+		}
+	}
+
+	// 1bpp to RGBA expansion and two plane compositing, per kernel and scale
+	void BenchExpand()
+	{
+		ExpandKernel const* kernels;
+		int kernelCount = AvailableExpandKernels(&kernels);
+
+		for (int k = 0; k < kernelCount; ++k)
+		{
+			for (int scale : { 1, 2, 4, 8, 16 })
+			{
+				Measure(std::string("expand/") + kernels[k].name + "/" + std::to_string(scale) + "x", "frames/s", [&]
+				{
+					uint64_t rows[VIDEO_HEIGHT];
+					for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+					{
+						rows[y] = 0x9E3779B97F4A7C15ull * (y + 1);
+					}
+
+					const uint32_t palette[2] = { 0x000000FF, 0xFFFFFFFF };
+					const int pitch = VIDEO_WIDTH * scale * sizeof(uint32_t);
+					std::vector<uint32_t> texture(VIDEO_WIDTH * scale * VIDEO_HEIGHT * scale);
+
+					const int frames = 20000 / scale;
+
+					auto start = Clock::now();
+					for (int i = 0; i < frames; ++i)
+					{
+						rows[i % VIDEO_HEIGHT] ^= i;
+						kernels[k].expand(rows, 1, VIDEO_WIDTH, VIDEO_HEIGHT, palette, scale, texture.data(), pitch);
+					}
+					auto end = Clock::now();
+
+					return frames / Seconds(start, end);
+				});
+			}
+		}
+
+		// XO-CHIP's two planes through the four colour palette, at 128x64
+		for (int k = 0; k < kernelCount; ++k)
+		{
+			for (int scale : { 1, 4 })
+			{
+				Measure(std::string("composite/") + kernels[k].name + "/" + std::to_string(scale) + "x", "frames/s", [&]
+				{
+					uint64_t planes[PLANE_COUNT][VIDEO_WORDS];
+					for (unsigned int i = 0; i < VIDEO_WORDS; ++i)
+					{
+						planes[0][i] = 0x9E3779B97F4A7C15ull * (i + 1);
+						planes[1][i] = 0xC2B2AE3D27D4EB4Full * (i + 1);
+					}
+
+					const uint32_t palette[4] = { 0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF };
+					const int pitch = HIRES_VIDEO_WIDTH * scale * sizeof(uint32_t);
+					std::vector<uint32_t> texture(HIRES_VIDEO_WIDTH * scale * HIRES_VIDEO_HEIGHT * scale);
+
+					const int frames = 5000 / scale;
+
+					auto start = Clock::now();
+					for (int i = 0; i < frames; ++i)
+					{
+						planes[i & 1][i % VIDEO_WORDS] ^= i;
+						kernels[k].composite(planes[0], planes[1], 2, HIRES_VIDEO_WIDTH, HIRES_VIDEO_HEIGHT, palette, scale, texture.data(), pitch);
+					}
+					auto end = Clock::now();
+
+					return frames / Seconds(start, end);
+				});
+			}
+		}
+	}
+
+#if defined(CHIP8_BENCH_PLATFORM)
+	// Platform::Update into a hidden window with the refresh limit off, so every
+	// call expands, uploads and presents a changed frame
+	void BenchPresent()
+	{
+		for (int upscale : { 1, 4 })
+		{
+			Measure("present/" + std::to_string(upscale) + "x", "us/op", [&]
+			{
+				Platform platform("CHIP-8 Benchmark", VIDEO_WIDTH * 8, VIDEO_HEIGHT * 8, VIDEO_WIDTH, VIDEO_HEIGHT, upscale, true);
+				platform.SetRefreshLimit(false);
+
+				uint64_t rows[VIDEO_HEIGHT];
+				for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y)
+				{
+					rows[y] = 0x9E3779B97F4A7C15ull * (y + 1);
+				}
+
+				const uint32_t frames = 500;
+
+				auto start = Clock::now();
+				for (uint32_t generation = 1; generation <= frames; ++generation)
+				{
+					rows[generation % VIDEO_HEIGHT] ^= generation;
+					platform.Update(rows, nullptr, generation);
+				}
+				auto end = Clock::now();
+
+				return Seconds(start, end) / frames * 1e6;
+			});
+		}
+	}
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<char const*> roms;
+	bool usage = false;
+
+	for (int i = 1; i < argc && !usage; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--reps" && hasValue)
+		{
+			options.reps = std::stoul(argv[++i]);
+			usage = options.reps == 0;
+		}
+		else if (arg == "--cycles" && hasValue)
+		{
+			options.cycles = std::stoul(argv[++i]);
+			usage = options.cycles == 0;
+		}
+		else if (arg == "--filter" && hasValue)
+		{
+			options.filter = argv[++i];
+		}
+		else if (arg[0] != '-')
+		{
+			roms.push_back(argv[i]);
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	if (usage)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--reps <N>] [--cycles <N>] [--filter <Text>] [<ROM>...]\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	std::cout << "benchmark,unit,reps,mean,stddev,min,max\n";
+
+	BenchOpcodeClasses();
+	BenchDraw();
+
+	for (char const* rom : roms)
+	{
+		BenchROM(rom);
+	}
+
+	BenchRandom();
+	BenchAudio();
+	BenchExpand();
+
+#if defined(CHIP8_BENCH_PLATFORM)
+	BenchPresent();
+#endif
+
+	return 0;
+}
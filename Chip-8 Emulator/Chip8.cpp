@@ -3,11 +3,11 @@
 #include <cstring>
 #include <random>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
 #include "Chip8.hpp"
-
-const unsigned int START_ADDRESS = 0x200;
-const unsigned int FONTSET_START_ADDRESS = 0x50;
-const unsigned int FONTSET_SIZE = 80;
+#include "Jit.hpp"
+#include "Trace.hpp"
 
 uint8_t fontset[FONTSET_SIZE] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -28,77 +28,253 @@ uint8_t fontset[FONTSET_SIZE] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-Chip8::Chip8():randGen(std::chrono::system_clock::now().time_since_epoch().count()){
+uint8_t bigFontset[BIG_FONTSET_SIZE] = {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+Chip8::Chip8(Backend backend):backend(backend), decoded(MEMORY_SIZE){
     //initialize PC
     pc = START_ADDRESS;
 
-    //initial RNG, randGen will be passed into randByte to get a random byte
-    randByte = std::uniform_int_distribution<uint8_t>(0, 255U);
+    //seed the RNG from the clock; SetRandom replaces it for reproducible runs
+    SetRandom(RandomSource::Pcg, std::chrono::system_clock::now().time_since_epoch().count());
 
     //load fonts into memory starting at address 0x50
     for(unsigned int i = 0; i < FONTSET_SIZE; i++){
         memory[FONTSET_START_ADDRESS + i] = fontset[i];
     }
 
+    //and the SUPER-CHIP large digits right after them
+    memcpy(memory + BIG_FONTSET_START_ADDRESS, bigFontset, BIG_FONTSET_SIZE);
+
 	//set up function pointer table
-	table[0x0] = &Chip8::Table0;
-	table[0x1] = &Chip8::OP_1nnn;
-	table[0x2] = &Chip8::OP_2nnn;
-	table[0x3] = &Chip8::OP_3xkk;
-	table[0x4] = &Chip8::OP_4xkk;
-	table[0x5] = &Chip8::OP_5xy0;
-	table[0x6] = &Chip8::OP_6xkk;
-	table[0x7] = &Chip8::OP_7xkk;
-	table[0x8] = &Chip8::Table8;
-	table[0x9] = &Chip8::OP_9xy0;
-	table[0xA] = &Chip8::OP_Annn;
-	table[0xB] = &Chip8::OP_Bnnn;
-	table[0xC] = &Chip8::OP_Cxkk;
-	table[0xD] = &Chip8::OP_Dxyn;
-	table[0xE] = &Chip8::TableE;
-	table[0xF] = &Chip8::TableF;
-
-	for (size_t i = 0; i <= 0xE; i++){
-		table0[i] = &Chip8::OP_NULL;
-		table8[i] = &Chip8::OP_NULL;
-		tableE[i] = &Chip8::OP_NULL;
-	}
-
-	table0[0x0] = &Chip8::OP_00E0;
-	table0[0xE] = &Chip8::OP_00EE;
-
-	table8[0x0] = &Chip8::OP_8xy0;
-	table8[0x1] = &Chip8::OP_8xy1;
-	table8[0x2] = &Chip8::OP_8xy2;
-	table8[0x3] = &Chip8::OP_8xy3;
-	table8[0x4] = &Chip8::OP_8xy4;
-	table8[0x5] = &Chip8::OP_8xy5;
-	table8[0x6] = &Chip8::OP_8xy6;
-	table8[0x7] = &Chip8::OP_8xy7;
-	table8[0xE] = &Chip8::OP_8xyE;
-
-	tableE[0x1] = &Chip8::OP_ExA1;
-	tableE[0xE] = &Chip8::OP_Ex9E;
-
-	for (size_t i = 0; i <= 0x65; i++){
-		tableF[i] = &Chip8::OP_NULL;
-	}
-
-	tableF[0x07] = &Chip8::OP_Fx07;
-	tableF[0x0A] = &Chip8::OP_Fx0A;
-	tableF[0x15] = &Chip8::OP_Fx15;
-	tableF[0x18] = &Chip8::OP_Fx18;
-	tableF[0x1E] = &Chip8::OP_Fx1E;
-	tableF[0x29] = &Chip8::OP_Fx29;
-	tableF[0x33] = &Chip8::OP_Fx33;
-	tableF[0x55] = &Chip8::OP_Fx55;
-	tableF[0x65] = &Chip8::OP_Fx65;
-
-}
-
-
-//loads the contents of a ROM file into the Chip8's memory
-void Chip8::LoadROM(char const* filename){
+	UseQuirks<DefaultQuirks>();
+
+#if !defined(CHIP8_PROFILE)
+	if (backend == Backend::Jit && Jit::Supported()){
+		jit.reset(new Jit(*this));
+	}
+#endif
+}
+
+Chip8::~Chip8() = default;
+
+Chip8::Op Chip8::DecodeOp(uint16_t opcode, bool superChip, bool xoChip){
+	uint8_t kk = opcode & 0x00FFu;
+	uint8_t n = opcode & 0x000Fu;
+
+	switch ((opcode & 0xF000u) >> 12u){
+		case 0x0:
+			if (!superChip){
+				//without the SUPER-CHIP instructions only the low nibble is looked at, so 0nn0 clears and 0nnE returns
+				return n == 0x0 ? Op::OP_00E0 : n == 0xE ? Op::OP_00EE : Op::OP_NULL;
+			}
+
+			if ((kk & 0xF0u) == 0xC0u){
+				return Op::OP_00Cn;
+			}
+
+			switch (kk){
+				case 0xE0: return Op::OP_00E0;
+				case 0xEE: return Op::OP_00EE;
+				case 0xFB: return Op::OP_00FB;
+				case 0xFC: return Op::OP_00FC;
+				case 0xFD: return Op::OP_00FD;
+				case 0xFE: return Op::OP_00FE;
+				case 0xFF: return Op::OP_00FF;
+				default: return Op::OP_NULL;
+			}
+		case 0x1: return Op::OP_1nnn;
+		case 0x2: return Op::OP_2nnn;
+		case 0x3: return Op::OP_3xkk;
+		case 0x4: return Op::OP_4xkk;
+		case 0x5:
+			if (!xoChip){
+				return Op::OP_5xy0;
+			}
+
+			//only 5xy0 keeps its meaning in the 5 group, which otherwise ignores the low nibble
+			switch (n){
+				case 0x0: return Op::OP_5xy0;
+				case 0x2: return Op::OP_5xy2;
+				case 0x3: return Op::OP_5xy3;
+				default: return Op::OP_NULL;
+			}
+		case 0x6: return Op::OP_6xkk;
+		case 0x7: return Op::OP_7xkk;
+		case 0x8:
+			switch (n){
+				case 0x0: return Op::OP_8xy0;
+				case 0x1: return Op::OP_8xy1;
+				case 0x2: return Op::OP_8xy2;
+				case 0x3: return Op::OP_8xy3;
+				case 0x4: return Op::OP_8xy4;
+				case 0x5: return Op::OP_8xy5;
+				case 0x6: return Op::OP_8xy6;
+				case 0x7: return Op::OP_8xy7;
+				case 0xE: return Op::OP_8xyE;
+				default: return Op::OP_NULL;
+			}
+		case 0x9: return Op::OP_9xy0;
+		case 0xA: return Op::OP_Annn;
+		case 0xB: return Op::OP_Bnnn;
+		case 0xC: return Op::OP_Cxkk;
+		case 0xD: return Op::OP_Dxyn;
+		case 0xE:
+			//only the low nibble tells the two key skips apart
+			return n == 0xE ? Op::OP_Ex9E : n == 0x1 ? Op::OP_ExA1 : Op::OP_NULL;
+		default:
+			switch (kk){
+				case 0x00: return xoChip ? Op::OP_F000 : Op::OP_NULL;
+				case 0x01: return xoChip ? Op::OP_Fn01 : Op::OP_NULL;
+				case 0x02: return xoChip ? Op::OP_F002 : Op::OP_NULL;
+				case 0x07: return Op::OP_Fx07;
+				case 0x0A: return Op::OP_Fx0A;
+				case 0x15: return Op::OP_Fx15;
+				case 0x18: return Op::OP_Fx18;
+				case 0x1E: return Op::OP_Fx1E;
+				case 0x29: return Op::OP_Fx29;
+				case 0x30: return superChip ? Op::OP_Fx30 : Op::OP_NULL;
+				case 0x33: return Op::OP_Fx33;
+				case 0x3A: return xoChip ? Op::OP_Fx3A : Op::OP_NULL;
+				case 0x55: return Op::OP_Fx55;
+				case 0x65: return Op::OP_Fx65;
+				case 0x75: return superChip ? Op::OP_Fx75 : Op::OP_NULL;
+				case 0x85: return superChip ? Op::OP_Fx85 : Op::OP_NULL;
+				default: return Op::OP_NULL;
+			}
+	}
+}
+
+//every quirk-dependent handler is a template over the quirk policy, so the table
+//entries are pointed at the instantiation for the profile and never test a quirk
+template<typename Quirks>
+Chip8::Chip8Func Chip8::Handler(Op op){
+	switch (op){
+		case Op::OP_00Cn: return &Chip8::OP_00Cn;
+		case Op::OP_00E0: return &Chip8::OP_00E0;
+		case Op::OP_00EE: return &Chip8::OP_00EE;
+		case Op::OP_00FB: return &Chip8::OP_00FB;
+		case Op::OP_00FC: return &Chip8::OP_00FC;
+		case Op::OP_00FD: return &Chip8::OP_00FD;
+		case Op::OP_00FE: return &Chip8::OP_00FE;
+		case Op::OP_00FF: return &Chip8::OP_00FF;
+		case Op::OP_1nnn: return &Chip8::OP_1nnn;
+		case Op::OP_2nnn: return &Chip8::OP_2nnn;
+		//the skips step over F000 nnnn whole on XO-CHIP
+		case Op::OP_3xkk: return &Chip8::OP_3xkk<Quirks>;
+		case Op::OP_4xkk: return &Chip8::OP_4xkk<Quirks>;
+		case Op::OP_5xy0: return &Chip8::OP_5xy0<Quirks>;
+		case Op::OP_5xy2: return &Chip8::OP_5xy2;
+		case Op::OP_5xy3: return &Chip8::OP_5xy3;
+		case Op::OP_6xkk: return &Chip8::OP_6xkk;
+		case Op::OP_7xkk: return &Chip8::OP_7xkk;
+		case Op::OP_8xy0: return &Chip8::OP_8xy0;
+		case Op::OP_8xy1: return &Chip8::OP_8xy1<Quirks>;
+		case Op::OP_8xy2: return &Chip8::OP_8xy2<Quirks>;
+		case Op::OP_8xy3: return &Chip8::OP_8xy3<Quirks>;
+		case Op::OP_8xy4: return &Chip8::OP_8xy4;
+		case Op::OP_8xy5: return &Chip8::OP_8xy5;
+		case Op::OP_8xy6: return &Chip8::OP_8xy6<Quirks>;
+		case Op::OP_8xy7: return &Chip8::OP_8xy7;
+		case Op::OP_8xyE: return &Chip8::OP_8xyE<Quirks>;
+		case Op::OP_9xy0: return &Chip8::OP_9xy0<Quirks>;
+		case Op::OP_Annn: return &Chip8::OP_Annn;
+		case Op::OP_Bnnn: return &Chip8::OP_Bnnn<Quirks>;
+		case Op::OP_Cxkk: return &Chip8::OP_Cxkk;
+		case Op::OP_Dxyn: return &Chip8::OP_Dxyn<Quirks>;
+		case Op::OP_Ex9E: return &Chip8::OP_Ex9E<Quirks>;
+		case Op::OP_ExA1: return &Chip8::OP_ExA1<Quirks>;
+		case Op::OP_F000: return &Chip8::OP_F000;
+		case Op::OP_Fn01: return &Chip8::OP_Fn01;
+		case Op::OP_F002: return &Chip8::OP_F002;
+		case Op::OP_Fx07: return &Chip8::OP_Fx07;
+		case Op::OP_Fx0A: return &Chip8::OP_Fx0A;
+		case Op::OP_Fx15: return &Chip8::OP_Fx15;
+		case Op::OP_Fx18: return &Chip8::OP_Fx18;
+		case Op::OP_Fx1E: return &Chip8::OP_Fx1E;
+		case Op::OP_Fx29: return &Chip8::OP_Fx29;
+		case Op::OP_Fx30: return &Chip8::OP_Fx30;
+		case Op::OP_Fx33: return &Chip8::OP_Fx33;
+		case Op::OP_Fx3A: return &Chip8::OP_Fx3A;
+		case Op::OP_Fx55: return &Chip8::OP_Fx55<Quirks>;
+		case Op::OP_Fx65: return &Chip8::OP_Fx65<Quirks>;
+		case Op::OP_Fx75: return &Chip8::OP_Fx75;
+		case Op::OP_Fx85: return &Chip8::OP_Fx85;
+		default: return &Chip8::OP_NULL;
+	}
+}
+
+//each table entry stands for the opcodes Decode sends to it, which DecodeOp
+//tells apart by the same bits; the 0, 5, 8, E and F entries of table are unused
+template<typename Quirks>
+void Chip8::UseQuirks(){
+	for (uint16_t i = 0; i <= 0xF; i++){
+		table[i] = Handler<Quirks>(DecodeOp(i << 12u, Quirks::superChip, Quirks::xoChip));
+		table5[i] = Handler<Quirks>(DecodeOp(0x5000u | i, Quirks::superChip, Quirks::xoChip));
+		table8[i] = Handler<Quirks>(DecodeOp(0x8000u | i, Quirks::superChip, Quirks::xoChip));
+		tableE[i] = Handler<Quirks>(DecodeOp(0xE000u | i, Quirks::superChip, Quirks::xoChip));
+	}
+
+	for (uint16_t i = 0; i <= 0xFF; i++){
+		table0[i] = Handler<Quirks>(DecodeOp(i, Quirks::superChip, Quirks::xoChip));
+		tableF[i] = Handler<Quirks>(DecodeOp(0xF000u | i, Quirks::superChip, Quirks::xoChip));
+	}
+}
+
+void Chip8::SetQuirks(QuirkProfile profile){
+	switch (profile){
+		case QuirkProfile::Vip: UseQuirks<VipQuirks>(); break;
+		case QuirkProfile::Chip48: UseQuirks<Chip48Quirks>(); break;
+		case QuirkProfile::Schip: UseQuirks<SchipQuirks>(); break;
+		case QuirkProfile::XoChip: UseQuirks<XoChipQuirks>(); break;
+		default: UseQuirks<DefaultQuirks>(); break;
+	}
+
+	quirks = profile;
+	QuirkFlags flags = GetQuirkFlags(profile);
+
+#if defined(CHIP8_PROFILE)
+	profiler.SetSuperChip(flags.superChip);
+#endif
+
+	//128x64 mode only exists with the SUPER-CHIP instructions
+	if (hires && !flags.superChip){
+		SetHighResolution(false);
+	}
+
+	//and the memory past 4 KB and the second plane only with XO-CHIP's
+	addressMask = flags.xoChip ? XO_MEMORY_SIZE - 1u : MEMORY_SIZE - 1u;
+	decoded.resize(MemorySize());
+
+	if (!flags.xoChip){
+		planeMask = 1;
+		memset(video[1], 0, sizeof(video[1]));
+		++frameGeneration;
+	}
+
+	//cached decodes hold handlers, and compiled blocks code, for the old quirks
+	Invalidate(0, MemorySize());
+}
+
+
+//loads the contents of a ROM file into the Chip8's memory, returns false if the file cannot be opened
+bool Chip8::LoadROM(char const* filename){
     //open tge file as a stream of binary and move the file pointer to the end
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
 
@@ -113,130 +289,331 @@ void Chip8::LoadROM(char const* filename){
         file.close();
 
         //load the rom contents into the Chip8's memory, starting at 0x200
-        for(long i = 0; i < size; i++){
-            memory[START_ADDRESS + i] = buffer[i];
-        }
+        LoadROM(reinterpret_cast<uint8_t const*>(buffer), static_cast<size_t>(size));
 
         //free the buffer
         delete[] buffer;
+
+        return true;
+    }
+
+    return false;
+}
+
+void Chip8::LoadROM(uint8_t const* data, size_t size){
+    //anything past the end of memory is dropped; the whole 64 KB is loaded whatever
+    //the profile, so SetQuirks can come before or after the ROM
+    if(size > XO_MEMORY_SIZE - START_ADDRESS){
+        size = XO_MEMORY_SIZE - START_ADDRESS;
     }
+
+    memcpy(memory + START_ADDRESS, data, size);
+
+    //anything decoded before the load is stale now
+    Invalidate(0, MemorySize());
 }
 
 //implementing the opcodes
 //00E0: CLS
 //clear the display
-void Chip8::OP_00E0(){
+void Chip8::OP_00E0(Instruction const&){
+    ClearScreen();
+    events |= EVENT_DRAW;
+}
+
+void Chip8::ClearScreen(){
+    for (unsigned int plane = 0; plane < PLANE_COUNT; ++plane){
+        if (planeMask & (1u << plane)){
+            memset(video[plane], 0, sizeof(video[plane]));
+        }
+    }
+    ++frameGeneration;
+}
+
+//00Cn: SCD nibble
+//scroll the display down n rows of the current mode
+void Chip8::OP_00Cn(Instruction const& instruction){
+    ScrollDown(instruction.n);
+    events |= EVENT_DRAW;
+}
+
+//scrolls move whole rows with memmove and whole columns with shifts across each
+//row's words; games scroll every frame, so nothing here goes pixel by pixel
+void Chip8::ScrollDown(unsigned int rows){
+    unsigned int wordsPerRow = hires ? 2u : 1u;
+    unsigned int words = VideoWords();
+    unsigned int shift = rows * wordsPerRow;
+
+    if (shift > words){
+        shift = words;
+    }
+
+    for (unsigned int plane = 0; plane < PLANE_COUNT; ++plane){
+        if (planeMask & (1u << plane)){
+            memmove(video[plane] + shift, video[plane], (words - shift) * sizeof(uint64_t));
+            memset(video[plane], 0, shift * sizeof(uint64_t));
+        }
+    }
+    ++frameGeneration;
+}
+
+void Chip8::ScrollRight(unsigned int columns){
+    for (unsigned int plane = 0; plane < PLANE_COUNT; ++plane){
+        if (!(planeMask & (1u << plane))){
+            continue;
+        }
+
+        uint64_t* rows = video[plane];
+
+        if (hires){
+            for (unsigned int row = 0; row < HIRES_VIDEO_HEIGHT; ++row){
+                uint64_t& left = rows[2 * row];
+                uint64_t& right = rows[2 * row + 1];
+                right = (right >> columns) | (left << (64u - columns));
+                left >>= columns;
+            }
+        }else{
+            for (unsigned int row = 0; row < VIDEO_HEIGHT; ++row){
+                rows[row] >>= columns;
+            }
+        }
+    }
+
+    ++frameGeneration;
+}
+
+void Chip8::ScrollLeft(unsigned int columns){
+    for (unsigned int plane = 0; plane < PLANE_COUNT; ++plane){
+        if (!(planeMask & (1u << plane))){
+            continue;
+        }
+
+        uint64_t* rows = video[plane];
+
+        if (hires){
+            for (unsigned int row = 0; row < HIRES_VIDEO_HEIGHT; ++row){
+                uint64_t& left = rows[2 * row];
+                uint64_t& right = rows[2 * row + 1];
+                left = (left << columns) | (right >> (64u - columns));
+                right <<= columns;
+            }
+        }else{
+            for (unsigned int row = 0; row < VIDEO_HEIGHT; ++row){
+                rows[row] <<= columns;
+            }
+        }
+    }
+
+    ++frameGeneration;
+}
+
+void Chip8::SetHighResolution(bool enabled){
+    hires = enabled;
     memset(video, 0, sizeof(video));
+    ++frameGeneration;
 }
 
 //00EE: RET
 //return from a subroutine
-void Chip8::OP_00EE(){
-    --sp;
+void Chip8::OP_00EE(Instruction const&){
+    //the stack pointer wraps instead of running off either end of the stack
+    sp = (sp - 1u) & (STACK_LEVELS - 1u);
     pc = stack[sp];
 }
 
+//00FB: SCR
+//scroll the display right four pixels
+void Chip8::OP_00FB(Instruction const&){
+    ScrollRight(4);
+    events |= EVENT_DRAW;
+}
+
+//00FC: SCL
+//scroll the display left four pixels
+void Chip8::OP_00FC(Instruction const&){
+    ScrollLeft(4);
+    events |= EVENT_DRAW;
+}
+
+//00FD: EXIT
+//stop the interpreter; the machine stays on this instruction from now on
+void Chip8::OP_00FD(Instruction const&){
+    pc -= 2;
+
+    if (idleSkip && !trace){
+        events |= EVENT_IDLE_LOOP;
+    }
+}
+
+//00FE: LOW
+//switch to the 64x32 display
+void Chip8::OP_00FE(Instruction const&){
+    SetHighResolution(false);
+    events |= EVENT_DRAW;
+}
+
+//00FF: HIGH
+//switch to the 128x64 display
+void Chip8::OP_00FF(Instruction const&){
+    SetHighResolution(true);
+    events |= EVENT_DRAW;
+}
+
 //1nnn: JP addr
 //jump to location nnn
-void Chip8::OP_1nnn(){
-    uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_1nnn(Instruction const& instruction){
+    uint16_t address = instruction.nnn;
+    uint16_t jump = pc - 2;
     pc = address;
+
+    //only a jump to itself or back over a timer poll can close an idle loop
+    if (idleSkip && !trace && (address == jump || address + 4u == jump) && IsIdleLoop(jump, address, delayTimer)){
+        events |= EVENT_IDLE_LOOP;
+    }
 }
 
 //2nnn: CALL addr
 //call subroutine at nnn
-void Chip8::OP_2nnn(){
-    uint16_t address = opcode & 0xFFFu;
+void Chip8::OP_2nnn(Instruction const& instruction){
+    uint16_t address = instruction.nnn;
     stack[sp] = pc;
-    ++sp;
+    sp = (sp + 1u) & (STACK_LEVELS - 1u);
     pc = address;
 }
 
 //3xkk: SE Vx, byte
 //skip next instruction if Vx = kk
-void Chip8::OP_3xkk(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;//Vx is a register number 0 - F
-    uint8_t byte = opcode & 0x00FFu;
+template<typename Quirks>
+void Chip8::OP_3xkk(Instruction const& instruction){
+    uint8_t Vx = instruction.x;//Vx is a register number 0 - F
+    uint8_t byte = instruction.kk;
     if(registers[Vx] == byte){//registers hold a byte per location
-        pc += 2;
+        pc += SkipLength<Quirks>(pc);
     }
 }
 
 //4xkk: SNE Vx, byte
 //skip next instruction if Vx != kk
-void Chip8::OP_4xkk(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint16_t byte = opcode & 0x00FFu;
+template<typename Quirks>
+void Chip8::OP_4xkk(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint16_t byte = instruction.kk;
     if(registers[Vx] != byte){
-        pc += 2;
+        pc += SkipLength<Quirks>(pc);
     }
 }
 
 //5xy0: SE Vx, Vy
 //skip next instruction if Vx = Vy
-void Chip8::OP_5xy0(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template<typename Quirks>
+void Chip8::OP_5xy0(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
     if(registers[Vx] == registers[Vy]){
-        pc += 2;
+        pc += SkipLength<Quirks>(pc);
+    }
+}
+
+//5xy2: SAVE Vx - Vy
+//store registers Vx through Vy in memory starting at location I, counting down from Vx when x > y
+//I is left as it is
+void Chip8::OP_5xy2(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
+    int step = Vx <= Vy ? 1 : -1;
+    unsigned int count = (Vx <= Vy ? Vy - Vx : Vx - Vy) + 1u;
+
+    for (unsigned int i = 0; i < count; ++i){
+        memory[(index + i) & addressMask] = registers[Vx + step * int(i)];
+    }
+
+    Invalidate(index, count);
+}
+
+//5xy3: LOAD Vx - Vy
+//read registers Vx through Vy from memory starting at location I, as 5xy2 stores them
+void Chip8::OP_5xy3(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
+    int step = Vx <= Vy ? 1 : -1;
+    unsigned int count = (Vx <= Vy ? Vy - Vx : Vx - Vy) + 1u;
+
+    for (unsigned int i = 0; i < count; ++i){
+        registers[Vx + step * int(i)] = memory[(index + i) & addressMask];
     }
 }
 
 //6xkk: LD Vx, byte
 //load kk into register Vx meaning Vx = kk
-void Chip8::OP_6xkk(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_6xkk(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
     registers[Vx] = byte;
 }
 
 //7xkk: ADD Vx, byte
 //add kk to register Vx meaning Vx = Vx + kk
-void Chip8::OP_7xkk(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_7xkk(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
     registers[Vx] += byte;
 }
 
 //8xy0: LD Vx, Vy
 //load register Vy into Vx meaning Vx = Vy
-void Chip8::OP_8xy0(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy0(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
     registers[Vx] = registers[Vy];
 }
 
 //8xy1: OR Vx, Vy
 //bitwise OR Vx = Vx OR Vy
-void Chip8::OP_8xy1(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+//the VIP clears Vf as a side effect of the logic ops
+template<typename Quirks>
+void Chip8::OP_8xy1(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
     registers[Vx] |= registers[Vy];
+
+    if (Quirks::resetVf){
+        registers[0xF] = 0;
+    }
 }
 
 //8xy2: AND Vx, Vy
 //bitwise AND Vx = Vx AND Vy
-void Chip8::OP_8xy2(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template<typename Quirks>
+void Chip8::OP_8xy2(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
     registers[Vx] &= registers[Vy];
+
+    if (Quirks::resetVf){
+        registers[0xF] = 0;
+    }
 }
 
 //8xy3: XOR Vx, Vy
 //bitwise XOR Vx = Vx ^ Vy
-void Chip8::OP_8xy3(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template<typename Quirks>
+void Chip8::OP_8xy3(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 	registers[Vx] ^= registers[Vy];
+
+	if (Quirks::resetVf){
+		registers[0xF] = 0;
+	}
 }
 
 //8xy4: ADD Vx, Vy
 //Vx = Vx + Vy, Vf = carry
 //if sum  > 255 then Vf is set to 1, otherwise 0
 //only the lowest 8 bits of the sum are kept, and stored in Vx
-void Chip8::OP_8xy4(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy4(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 
 	uint16_t sum = registers[Vx] + registers[Vy];
 
@@ -253,9 +630,9 @@ void Chip8::OP_8xy4(){
 //Vx = Vx - Vy, Vf = NOT borrow
 //if Vx > Vy then Vf is set to 1, otherwise 0
 //Vy is then subtracted from Vx and the value is stored in Vx
-void Chip8::OP_8xy5(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy5(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 
 	if (registers[Vx] > registers[Vy]){
 		registers[0xF] = 1;
@@ -269,21 +646,24 @@ void Chip8::OP_8xy5(){
 //8xy6: SHR Vx
 //right shift Vx by 1
 //if lsb of Vx is 1 then Vf is set to 1, otherwise 0
-void Chip8::OP_8xy6(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+//the VIP and XO-CHIP shift Vy into Vx instead
+template<typename Quirks>
+void Chip8::OP_8xy6(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t source = Quirks::shiftVy ? instruction.y : Vx;
 
 	// Save LSB in VF
-	registers[0xF] = (registers[Vx] & 0x1u);
+	registers[0xF] = (registers[source] & 0x1u);
 
-	registers[Vx] >>= 1;
+	registers[Vx] = registers[source] >> 1;
 }
 
 //8xy7: SUBN Vx, Vy
 //Vx = Vy - Vx, Vf = NOT borrow
 //if Vy > Vx, then Vf is set to 1, otherwise 0
-void Chip8::OP_8xy7(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy7(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 
 	if (registers[Vy] > registers[Vx]){
 		registers[0xF] = 1;
@@ -297,113 +677,270 @@ void Chip8::OP_8xy7(){
 //8xyE: SHL Vx
 //left shift Vx by 1
 //if the msb of Vx is 1 then Vf is set to one, otherwise 0
-void Chip8::OP_8xyE(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+//the VIP and XO-CHIP shift Vy into Vx instead
+template<typename Quirks>
+void Chip8::OP_8xyE(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t source = Quirks::shiftVy ? instruction.y : Vx;
 
 	// Save MSB in VF
-	registers[0xF] = (registers[Vx] & 0x80u) >> 7u;
+	registers[0xF] = (registers[source] & 0x80u) >> 7u;
 
-	registers[Vx] <<= 1;
+	registers[Vx] = registers[source] << 1;
 }
 
 //9xy0: SNE Vx, Vy
 //skip next instruction if Vx != Vy
-void Chip8::OP_9xy0(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template<typename Quirks>
+void Chip8::OP_9xy0(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 
 	if (registers[Vx] != registers[Vy])
 	{
-		pc += 2;
+		pc += SkipLength<Quirks>(pc);
 	}
 }
 
 //Annn: LD I, addr
 //load addr nnn into I
-void Chip8::OP_Annn(){
-	uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_Annn(Instruction const& instruction){
+	uint16_t address = instruction.nnn;
 
 	index = address;
 }
 
 //Bnnn: JP V0, addr
 //jump to location nnn + V0
-void Chip8::OP_Bnnn(){
-	uint16_t address = opcode & 0x0FFFu;
+//CHIP-48 and SCHIP read it as Bxnn and add Vx instead
+template<typename Quirks>
+void Chip8::OP_Bnnn(Instruction const& instruction){
+	uint16_t address = instruction.nnn;
 
-	pc = registers[0] + address;
+	pc = registers[Quirks::jumpVx ? instruction.x : 0] + address;
 }
 
 //Cxkk: RND Vx, byte
 //Vx = random byte AND kk
-void Chip8::OP_Cxkk(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_Cxkk(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t byte = instruction.kk;
 
-	registers[Vx] = randByte(randGen) & byte;
+	registers[Vx] = random.Next() & byte;
 }
 
 //Dxyn: DRW Vx, Vy, nibble
 //Display n-byte sprite starting at memory location
 //I at (Vx, Vy), set Vf = collision
-void Chip8::OP_Dxyn(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4U;
-    uint8_t height = opcode & 0x000Fu;
+template<typename Quirks>
+void Chip8::OP_Dxyn(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
+    uint8_t height = instruction.n;
+
+    //the extra SUPER-CHIP cases are only possible when its instructions are, and the planes with XO-CHIP's
+    if (Quirks::xoChip){
+        registers[0xF] = DrawPlanes(index, registers[Vx], registers[Vy], height, Quirks::wrapSprites);
+    }else if (Quirks::superChip && (hires || height == 0)){
+        registers[0xF] = DrawSpriteExtended(0, index, registers[Vx], registers[Vy], height, Quirks::wrapSprites);
+    }else if (Quirks::wrapSprites){
+        registers[0xF] = DrawSpriteWrapped(0, index, registers[Vx], registers[Vy], height);
+    }else{
+        registers[0xF] = DrawSprite(0, index, registers[Vx], registers[Vy], height);
+    }
+    events |= EVENT_DRAW;
+}
+
+//XO-CHIP draws the sprite on plane 0 and then plane 1 as selected, the second
+//plane's rows following the first's in memory; a collision on either sets Vf
+uint8_t Chip8::DrawPlanes(uint16_t address, uint8_t x, uint8_t y, uint8_t height, bool wrap){
+    unsigned int spriteBytes = height == 0 ? 32u : height;
+    uint8_t collision = 0;
+
+    for (unsigned int plane = 0; plane < PLANE_COUNT; ++plane){
+        if (!(planeMask & (1u << plane))){
+            continue;
+        }
 
-    //wrap if going beyond screen boundaries
-    uint8_t xPos = registers[Vx] % VIDEO_WIDTH;
-    uint8_t yPos = registers[Vy] % VIDEO_WIDTH;
+        if (hires || height == 0){
+            collision |= DrawSpriteExtended(plane, address, x, y, height, wrap);
+        }else if (wrap){
+            collision |= DrawSpriteWrapped(plane, address, x, y, height);
+        }else{
+            collision |= DrawSprite(plane, address, x, y, height);
+        }
+
+        address += spriteBytes;
+    }
 
-    registers[0xF] = 0;
+    return collision;
+}
+
+//draw the height byte sprite stored at address, returns 1 on collision and 0 otherwise
+//shared by every backend so they all produce the same frame
+uint8_t Chip8::DrawSprite(unsigned int plane, uint16_t address, uint8_t x, uint8_t y, uint8_t height){
+    //the start position wraps around the screen, the sprite itself is clipped at the edges
+    uint8_t xPos = x % VIDEO_WIDTH;
+    uint8_t yPos = y % VIDEO_HEIGHT;
+
+    uint64_t collision = 0;
+
+    ++frameGeneration;
+
+    for(unsigned int row = 0; row < height && yPos + row < VIDEO_HEIGHT; row++){
+        //line the sprite byte up with the row, column 0 being the most significant bit
+        uint64_t spriteRow = (uint64_t(memory[(address + row) & addressMask]) << 56u) >> xPos;
+        uint64_t& screenRow = video[plane][yPos + row];
+
+        //any pixel on in both is a collision
+        collision |= screenRow & spriteRow;
+        screenRow ^= spriteRow;
+    }
+
+    return collision ? 1 : 0;
+}
+
+//as DrawSprite, but the rows and columns past the edges come round on the far side
+uint8_t Chip8::DrawSpriteWrapped(unsigned int plane, uint16_t address, uint8_t x, uint8_t y, uint8_t height){
+    uint8_t xPos = x % VIDEO_WIDTH;
+    uint8_t yPos = y % VIDEO_HEIGHT;
+
+    uint64_t collision = 0;
+
+    ++frameGeneration;
 
     for(unsigned int row = 0; row < height; row++){
-        uint8_t spriteByte = memory[index + row];
-        for(unsigned int col = 0; col < 8; col++){
-            uint8_t spritePixel = spriteByte & (0x80u >> col);
-            uint32_t* screenPixel = &video[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
-
-            //sprite pixel is on
-            if(spritePixel){
-                //screen pixel is also on - collision
-                if(*screenPixel == 0xFFFFFFFF){
-                    registers[0xF] = 1;
-                }
-                *screenPixel ^= 0xFFFFFFFF;
+        //rotate rather than shift, so the columns pushed off the right reappear on the left
+        uint64_t spriteByte = uint64_t(memory[(address + row) & addressMask]) << 56u;
+        uint64_t spriteRow = (spriteByte >> xPos) | (spriteByte << ((VIDEO_WIDTH - xPos) & (VIDEO_WIDTH - 1u)));
+        uint64_t& screenRow = video[plane][(yPos + row) & (VIDEO_HEIGHT - 1u)];
+
+        collision |= screenRow & spriteRow;
+        screenRow ^= spriteRow;
+    }
+
+    return collision ? 1 : 0;
+}
+
+//the same for SUPER-CHIP sprites: height 0 draws 16x16 from 32 bytes, two per row, and
+//in 128x64 mode every row spans two words, so each sprite row is placed as a 128-bit
+//value; any collision sets Vf
+uint8_t Chip8::DrawSpriteExtended(unsigned int plane, uint16_t address, uint8_t x, uint8_t y, uint8_t height, bool wrap){
+    unsigned int width = VideoWidth();
+    unsigned int screenHeight = VideoHeight();
+    unsigned int xPos = x & (width - 1u);
+    unsigned int yPos = y & (screenHeight - 1u);
+    bool wide = height == 0;
+    unsigned int rows = wide ? 16u : height;
+
+    uint64_t collision = 0;
+
+    ++frameGeneration;
+
+    for(unsigned int row = 0; row < rows; row++){
+        unsigned int screenY = yPos + row;
+
+        if (screenY >= screenHeight){
+            if (!wrap){
+                break;
+            }
+            screenY -= screenHeight;
+        }
+
+        //the sprite row at the top of a word, then split across columns 0-63 and 64-127
+        uint64_t bits;
+        if (wide){
+            bits = uint64_t((memory[(address + 2u * row) & addressMask] << 8u) | memory[(address + 2u * row + 1u) & addressMask]) << 48u;
+        }else{
+            bits = uint64_t(memory[(address + row) & addressMask]) << 56u;
+        }
+
+        uint64_t left = xPos < 64u ? bits >> xPos : 0;
+        uint64_t right = xPos < 64u ? (xPos ? bits << (64u - xPos) : 0) : bits >> (xPos - 64u);
+
+        if (hires){
+            //past column 127 comes round to column 0
+            if (wrap && xPos > 64u){
+                left |= bits << (128u - xPos);
+            }
+
+            uint64_t& screenLeft = video[plane][2 * screenY];
+            uint64_t& screenRight = video[plane][2 * screenY + 1];
+            collision |= (screenLeft & left) | (screenRight & right);
+            screenLeft ^= left;
+            screenRight ^= right;
+        }else{
+            //a 16 pixel row can run past column 63, which right holds at columns 0 on
+            if (wrap){
+                left |= right;
             }
+
+            uint64_t& screenRow = video[plane][screenY];
+            collision |= screenRow & left;
+            screenRow ^= left;
         }
     }
+
+    return collision ? 1 : 0;
 }
 
 //Ex9E: SKP Vx
 //skip next instruction if key with the value of Vx is pressed
-void Chip8::OP_Ex9E(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template<typename Quirks>
+void Chip8::OP_Ex9E(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
-	uint8_t key = registers[Vx];
+	uint8_t key = registers[Vx] & (KEY_COUNT - 1u);
 
 	if (keypad[key]){
-		pc += 2;
+		pc += SkipLength<Quirks>(pc);
 	}
 }
 
 //ExA1: SKNP Vx
 //skip next instruction if key with the value of Vx i not pressed
-void Chip8::OP_ExA1(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template<typename Quirks>
+void Chip8::OP_ExA1(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
-	uint8_t key = registers[Vx];
+	uint8_t key = registers[Vx] & (KEY_COUNT - 1u);
 
 	if (!keypad[key])
 	{
-		pc += 2;
+		pc += SkipLength<Quirks>(pc);
+	}
+}
+
+//F000 nnnn: LD I, long addr
+//load the 16-bit address in the word after the instruction into I and step over it
+//only F000 itself is the four byte instruction, as SkipLength expects
+void Chip8::OP_F000(Instruction const& instruction){
+	if (instruction.x != 0){
+		return;
+	}
+
+	index = (memory[pc & addressMask] << 8u) | memory[(pc + 1u) & addressMask];
+	pc += 2;
+}
+
+//Fn01: PLANE n
+//select the planes Dxyn, 00E0 and the scrolls act on, bit 0 for plane 0 and bit 1 for plane 1
+void Chip8::OP_Fn01(Instruction const& instruction){
+	planeMask = instruction.x & ((1u << PLANE_COUNT) - 1u);
+}
+
+//F002: AUDIO
+//load the 16 byte audio pattern from memory starting at location I; x is ignored
+void Chip8::OP_F002(Instruction const&){
+	for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; ++i){
+		audioPattern[i] = memory[(index + i) & addressMask];
 	}
 }
 
 //Fx07: LD Vx, DT
 //Vx = delay timer value
-void Chip8::OP_Fx07(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx07(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     registers[Vx] = delayTimer;
 }
@@ -411,8 +948,8 @@ void Chip8::OP_Fx07(){
 //Fx0A: LD Vx, K
 //wait for a key press, store the value of the key in Vx
 //to wait, subract the program counter by two so that it repeatedly executes the same instruction until a key is pressed
-void Chip8::OP_Fx0A(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx0A(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
 	if (keypad[0]){
 		registers[Vx] = 0;
@@ -448,29 +985,34 @@ void Chip8::OP_Fx0A(){
 		registers[Vx] = 15;
 	}else{
 		pc -= 2;
+		events |= EVENT_KEY_WAIT;
 	}
 }
 
 //Fx15: LD DT, Vx
 //set delay timer = Vx
-void Chip8::OP_Fx15(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx15(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
 	delayTimer = registers[Vx];
 }
 
 //Fx18: LD ST, Vx
 //sound timer = Vx
-void Chip8::OP_Fx18(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx18(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+
+	if (soundTimer == 0 && registers[Vx] > 0){
+		events |= EVENT_SOUND_START;
+	}
 
 	soundTimer = registers[Vx];
 }
 
 //Fx1E: ADD I, Vx
 //I = I + Vx
-void Chip8::OP_Fx1E(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx1E(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
 	index += registers[Vx];
 }
@@ -478,93 +1020,479 @@ void Chip8::OP_Fx1E(){
 //Fx29: LD F, Vx
 //I = location of sprite for digit Vx
 //font characters are located at 0x50 and they are five bytes each
-void Chip8::OP_Fx29(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx29(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 	uint8_t digit = registers[Vx];
 
 	index = FONTSET_START_ADDRESS + (5 * digit);
 }
 
+//Fx30: LD HF, Vx
+//I = location of the large sprite for digit Vx
+//large characters are located at 0xA0 and they are ten bytes each
+void Chip8::OP_Fx30(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+	uint8_t digit = registers[Vx] & 0xFu;
+
+	index = BIG_FONTSET_START_ADDRESS + (10 * digit);
+}
+
 //Fx33: LD B, Vx
 //store BCD representation of Vx in memory locations I, I+1, and I+2
 //the interpreter takes the decimal value of Vx, and places the hundreds
 //digit in memory at location I, the tens digita at location I+1, and the ones digit at location I+2
-void Chip8::OP_Fx33(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx33(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 	uint8_t value = registers[Vx];
 
 	// Ones-place
-	memory[index + 2] = value % 10;
+	memory[(index + 2) & addressMask] = value % 10;
 	value /= 10;
 
 	// Tens-place
-	memory[index + 1] = value % 10;
+	memory[(index + 1) & addressMask] = value % 10;
 	value /= 10;
 
 	// Hundreds-place
-	memory[index] = value % 10;
+	memory[index & addressMask] = value % 10;
+
+	Invalidate(index, 3);
+}
+
+//Fx3A: PITCH Vx
+//set the pitch the audio pattern plays at to Vx
+void Chip8::OP_Fx3A(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+
+	pitch = registers[Vx];
+}
+
+//4000 bits a second at the default pitch of 64, an octave up or down for every 48 either side
+double PatternRate(uint8_t pitch){
+	return 4000.0 * std::pow(2.0, (pitch - 64.0) / 48.0);
+}
+
+double Chip8::PatternRate() const{
+	return ::PatternRate(pitch);
 }
 
 //Fx55: LD [I], Vx
 //store registers V0 through Vx in memory starting at location I
-void Chip8::OP_Fx55(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+//the VIP and XO-CHIP leave I one past the last register, CHIP-48 one short of that
+template<typename Quirks>
+void Chip8::OP_Fx55(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
 	for (uint8_t i = 0; i <= Vx; ++i)
 	{
-		memory[index + i] = registers[i];
+		memory[(index + i) & addressMask] = registers[i];
+	}
+
+	Invalidate(index, Vx + 1u);
+
+	if (Quirks::indexIncrement == IndexIncrement::XPlusOne){
+		index += Vx + 1u;
+	}else if (Quirks::indexIncrement == IndexIncrement::X){
+		index += Vx;
 	}
 }
 
 //Fx65: LD Vx, [I]
 //read registers V0 through Vx from memory starting at location I
-void Chip8::OP_Fx65(){
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+//I afterwards as for Fx55
+template<typename Quirks>
+void Chip8::OP_Fx65(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
 
 	for (uint8_t i = 0; i <= Vx; ++i)
 	{
-		registers[i] = memory[index + i];
+		registers[i] = memory[(index + i) & addressMask];
+	}
+
+	if (Quirks::indexIncrement == IndexIncrement::XPlusOne){
+		index += Vx + 1u;
+	}else if (Quirks::indexIncrement == IndexIncrement::X){
+		index += Vx;
 	}
 }
 
-//defining functions that retrieve the correct opcode function and also defining the OP_NULL instruction
-void Chip8::Table0(){
-	(this->*(table0[opcode & 0x000Fu]))();
+//Fx75: LD R, Vx
+//store registers V0 through Vx in the RPL flags
+void Chip8::OP_Fx75(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+
+	memcpy(rplFlags, registers, Vx + 1u);
 }
 
-void Chip8::Table8(){
-	(this->*(table8[opcode & 0x000Fu]))();
+//Fx85: LD Vx, R
+//read registers V0 through Vx from the RPL flags
+void Chip8::OP_Fx85(Instruction const& instruction){
+	uint8_t Vx = instruction.x;
+
+	memcpy(registers, rplFlags, Vx + 1u);
 }
 
-void Chip8::TableE(){
-	(this->*(tableE[opcode & 0x000Fu]))();
+//defining the OP_NULL instruction
+void Chip8::OP_NULL(Instruction const&){
 }
 
-void Chip8::TableF(){
-	(this->*(tableF[opcode & 0x00FFu]))();
+//decode the opcode at address once, resolving the second level tables and
+//extracting the operand fields so the handlers never touch the raw opcode
+void Chip8::Decode(Instruction& slot, uint16_t address){
+	uint16_t opcode = (memory[address] << 8u) | memory[(address + 1u) & addressMask];
+
+	switch ((opcode & 0xF000u) >> 12u){
+		case 0x0: slot.handler = table0[opcode & 0x00FFu]; break;
+		case 0x5: slot.handler = table5[opcode & 0x000Fu]; break;
+		case 0x8: slot.handler = table8[opcode & 0x000Fu]; break;
+		case 0xE: slot.handler = tableE[opcode & 0x000Fu]; break;
+		case 0xF: slot.handler = tableF[opcode & 0x00FFu]; break;
+		default:  slot.handler = table[(opcode & 0xF000u) >> 12u]; break;
+	}
+
+	slot.opcode = opcode;
+	slot.nnn = opcode & 0x0FFFu;
+	slot.x = (opcode & 0x0F00u) >> 8u;
+	slot.y = (opcode & 0x00F0u) >> 4u;
+	slot.kk = opcode & 0x00FFu;
+	slot.n = opcode & 0x000Fu;
 }
 
-void Chip8::OP_NULL(){
+Chip8::Instruction const& Chip8::Fetch(uint16_t address){
+	Instruction& slot = decoded[address & addressMask];
+
+	if (!slot.handler){
+		Decode(slot, address & addressMask);
+	}
+
+	return slot;
+}
+
+//a write to memory[address] changes the instructions starting at address and at address - 1
+//addresses wrap around the end of memory like every other memory access
+void Chip8::Invalidate(uint16_t address, unsigned int length){
+	if (length >= MemorySize()){
+		length = MemorySize() - 1u;
+	}
+
+	for (unsigned int i = 0; i <= length; ++i){
+		decoded[(address - 1u + i) & addressMask].handler = nullptr;
+	}
+
+	if (jit){
+		jit->Invalidate(address, length);
+	}
 }
 
 //fetch, decode, execute
-void Chip8::Cycle(){
-	//fetch
-	opcode = (memory[pc] << 8u | memory[pc + 1]);
+void Chip8::Step(){
+	//fetch the predecoded instruction
+	Instruction const& instruction = Fetch(pc);
+
+#if defined(CHIP8_PROFILE)
+	uint16_t address = pc;
+	uint64_t start = Profiler::Now();
+#endif
 
 	//increment the pc before we execute anything
 	pc += 2;
 
-	//decode and execute
-	(this->*(table[(opcode & 0xF000u) >> 12u]))();
+	//execute
+	(this->*(instruction.handler))(instruction);
 
-	//decrement the delay timer if it's been set
-	if(delayTimer > 0){
-		--delayTimer;
+#if defined(CHIP8_PROFILE)
+	profiler.Record(address, instruction.opcode, Profiler::Now() - start);
+#endif
+}
+
+//the timers run at 60 Hz of emulated time, the scheduler says how many ticks the cycles covered
+void Chip8::AdvanceTimers(unsigned int cycles){
+	unsigned int ticks = scheduler.Advance(cycles);
+
+	if (ticks){
+		TickTimers(ticks);
 	}
+}
+
+void Chip8::TickTimers(unsigned int ticks){
+	//decrement the delay timer if it's been set
+	delayTimer = delayTimer > ticks ? delayTimer - ticks : 0;
 
 	//decrement the sound timer if it's been set
-	if(soundTimer > 0){
-		--soundTimer;
+	soundTimer = soundTimer > ticks ? soundTimer - ticks : 0;
+}
+
+void Chip8::Cycle(){
+	Step();
+	AdvanceTimers(1);
+}
+
+//run up to n cycles on the backend chosen at construction
+RunResult Chip8::RunCycles(unsigned int n){
+	events = 0;
+
+	RunResult result{};
+
+	while (result.cycles < n && !events){
+		if (trace){
+			result.cycles += RunTraced(n - result.cycles);
+		}else if (backend == Backend::Switch){
+			result.cycles += RunSwitch(n - result.cycles);
+		}else if (jit){
+			if (!jit->Interprets(pc)){
+				result.cycles += jit->Run(n - result.cycles);
+			}
+
+			//the jit stops at an instruction it has no native code for
+			if (result.cycles < n && !events){
+				Cycle();
+				++result.cycles;
+			}
+		}else{
+			while (result.cycles < n && !events){
+				Cycle();
+				++result.cycles;
+			}
+		}
+
+		//the backend stops at a jump closing an idle loop; skip what it would spin through and carry on
+		if (events & EVENT_IDLE_LOOP){
+			events &= ~EVENT_IDLE_LOOP;
+			result.cycles += SkipIdle(n - result.cycles);
+		}
+	}
+
+	//keys only change between batches, so a key wait spins until the end of this one
+	if ((events & EVENT_KEY_WAIT) && idleSkip && !trace){
+		result.cycles += SkipIdle(n - result.cycles);
+	}
+
+	result.events = events;
+
+	return result;
+}
+
+//the table loop again, with each instruction's pc, opcode, I and the register it
+//wrote pushed to the trace; registers are compared eight at a time to find the write
+unsigned int Chip8::RunTraced(unsigned int n){
+	unsigned int cycles = 0;
+
+	while (cycles < n && !events){
+		TraceRecord record;
+		record.cycle = scheduler.Cycles();
+		record.pc = pc;
+		record.opcode = Fetch(pc).opcode;
+
+		uint64_t before[2], after[2];
+		memcpy(before, registers, sizeof(before));
+
+		Cycle();
+		++cycles;
+
+		memcpy(after, registers, sizeof(after));
+		uint64_t low = before[0] ^ after[0];
+		uint64_t high = before[1] ^ after[1];
+
+		record.index = index;
+		record.changed = TRACE_NONE;
+		record.value = 0;
+
+		if (low | high){
+			//lowest written register, registers being bytes of the words in little-endian order
+			unsigned int reg = low ? 0u : 8u;
+			uint64_t diff = low ? low : high;
+			while (!(diff & 0xFFu)){
+				diff >>= 8u;
+				++reg;
+			}
+			record.changed = static_cast<uint8_t>(reg);
+			record.value = registers[reg];
+
+			//clear its byte and see what else changed
+			if (reg < 8u){
+				low &= ~(0xFFull << (8u * reg));
+			}else{
+				high &= ~(0xFFull << (8u * (reg - 8u)));
+			}
+
+			const uint64_t vf = 0xFFull << 56u;
+			if (low || (high & ~vf)){
+				record.changed |= TRACE_MORE;
+			}else if (high & vf){
+				record.changed |= TRACE_ALSO_VF;
+			}
+		}
+
+		trace->Push(record);
+	}
+
+	return cycles;
+}
+
+//an idle loop is a jump to itself, or Fx07 then 3xkk or 4xkk on the same register then
+//a jump back to the Fx07, which spins until the delay timer reads kk (3xkk) or stops
+//reading it (4xkk); the timer only changes on a tick, so until then the loop is idle
+bool Chip8::IsIdleLoop(uint16_t jump, uint16_t target, uint8_t dt) const{
+	if (target == jump){
+		return true;
+	}
+
+	uint16_t load = (memory[target & addressMask] << 8u) | memory[(target + 1u) & addressMask];
+	uint16_t test = (memory[(target + 2u) & addressMask] << 8u) | memory[(target + 3u) & addressMask];
+
+	if ((load & 0xF0FFu) != 0xF007u || (test & 0x0F00u) != (load & 0x0F00u)){
+		return false;
+	}
+
+	switch (test & 0xF000u){
+		case 0x3000u: return dt != (test & 0x00FFu);
+		case 0x4000u: return dt == (test & 0x00FFu);
+		default: return false;
 	}
-}
\ No newline at end of file
+}
+
+//pc is at the instruction an idle loop spins on: Fx0A, 00FD and a jump to itself change
+//nothing but the timers however long they run, so the whole budget goes; a timer poll
+//is skipped in whole three cycle iterations up to the next tick, leaving Vx holding the
+//timer as the last Fx07 would have, and the backend runs the rest
+unsigned int Chip8::SkipIdle(unsigned int n){
+	uint16_t opcode = (memory[pc & addressMask] << 8u) | memory[(pc + 1u) & addressMask];
+	unsigned int skipped = n;
+
+	if ((opcode & 0xF0FFu) == 0xF007u){
+		//the jump's own cycle can have ticked the timer since the loop was recognised
+		skipped = IsIdleLoop(pc + 4u, pc, delayTimer) ? std::min(n, scheduler.CyclesUntilTick()) / 3u * 3u : 0u;
+
+		if (skipped){
+			registers[(opcode & 0x0F00u) >> 8u] = delayTimer;
+		}
+	}
+
+	AdvanceTimers(skipped);
+	idleCycles += skipped;
+
+	return skipped;
+}
+
+RunResult Chip8::RunFrame(){
+	unsigned int remaining = scheduler.CyclesUntilTick();
+
+	RunResult result = RunCycles(remaining);
+
+	if (result.cycles == remaining){
+		result.events |= EVENT_FRAME_END;
+	}
+
+	return result;
+}
+
+RunResult Chip8::RunFrame(unsigned int instructionsPerFrame){
+	SetClockHz(instructionsPerFrame * TIMER_HZ);
+
+	return RunFrame();
+}
+
+void Chip8::SetClockHz(uint32_t clockHz){
+	scheduler.SetClockHz(clockHz);
+}
+
+void Chip8::SetRandom(RandomSource source, uint64_t seed){
+	random.Seed(source, seed);
+	this->seed = seed;
+}
+
+void Chip8::SetJitVerify(bool enabled){
+	if (jit){
+		jit->SetVerify(enabled);
+	}
+}
+
+unsigned long long Chip8::JitMismatches() const{
+	return jit ? jit->Mismatches() : 0;
+}
+//copy every part of the machine into state, one memcpy per block
+void Chip8::Save(MachineState& state) const{
+	state.magic = MACHINE_STATE_MAGIC;
+	state.version = MACHINE_STATE_VERSION;
+	state.scheduler = scheduler.GetState();
+	memcpy(state.video, video, sizeof(video));
+	memcpy(state.stack, stack, sizeof(stack));
+	state.pc = pc;
+	state.index = index;
+	state.rngState = random.State();
+	memcpy(state.registers, registers, sizeof(registers));
+	memcpy(state.keypad, keypad, sizeof(keypad));
+	state.sp = sp;
+	state.delayTimer = delayTimer;
+	state.soundTimer = soundTimer;
+	state.rngSource = static_cast<uint8_t>(random.Source());
+	memcpy(state.rplFlags, rplFlags, sizeof(rplFlags));
+	state.hires = hires ? 1 : 0;
+	state.planes = planeMask;
+	state.pitch = pitch;
+	state.quirks = static_cast<uint8_t>(quirks);
+	memset(state.reserved, 0, sizeof(state.reserved));
+	memcpy(state.audioPattern, audioPattern, sizeof(audioPattern));
+	memcpy(state.memory, memory, MemorySize());
+}
+
+//restore the machine from state, switching to the quirk profile that saved it;
+//only the 256 byte pages of memory that differ drop their decoded instructions
+//and compiled blocks, so branching many times from one snapshot keeps the caches warm
+bool Chip8::Load(MachineState const& state){
+	if (state.magic != MACHINE_STATE_MAGIC || state.version != MACHINE_STATE_VERSION || state.rngSource > static_cast<uint8_t>(RandomSource::MinStd)
+		|| state.quirks > static_cast<uint8_t>(QuirkProfile::XoChip) || state.hires > 1 || state.planes >= (1u << PLANE_COUNT)){
+		return false;
+	}
+
+	//hires and the second plane only exist under the profiles whose handlers drive them
+	QuirkProfile profile = static_cast<QuirkProfile>(state.quirks);
+	QuirkFlags flags = GetQuirkFlags(profile);
+	if ((state.hires && !flags.superChip) || (state.planes != 1 && !flags.xoChip)){
+		return false;
+	}
+
+	if (profile != quirks){
+		SetQuirks(profile);
+	}
+
+	//only the profile's memory is part of the state; past it this machine keeps its own
+	const unsigned int pageSize = 256;
+	const unsigned int pageCount = MemorySize() / pageSize;
+	bool changed[XO_MEMORY_SIZE / pageSize];
+
+	for (unsigned int page = 0; page < pageCount; ++page){
+		changed[page] = memcmp(memory + page * pageSize, state.memory + page * pageSize, pageSize) != 0;
+	}
+
+	memcpy(memory, state.memory, MemorySize());
+
+	for (unsigned int page = 0; page < pageCount; ++page){
+		if (changed[page]){
+			Invalidate(page * pageSize, pageSize);
+		}
+	}
+
+	scheduler.SetState(state.scheduler);
+	memcpy(video, state.video, sizeof(video));
+	memcpy(stack, state.stack, sizeof(stack));
+	pc = state.pc;
+	index = state.index;
+	random.Restore(static_cast<RandomSource>(state.rngSource), state.rngState);
+	memcpy(registers, state.registers, sizeof(registers));
+	memcpy(keypad, state.keypad, sizeof(keypad));
+	sp = state.sp & (STACK_LEVELS - 1u);
+	delayTimer = state.delayTimer;
+	soundTimer = state.soundTimer;
+	memcpy(rplFlags, state.rplFlags, sizeof(rplFlags));
+	hires = state.hires != 0;
+	planeMask = state.planes;
+	pitch = state.pitch;
+	memcpy(audioPattern, state.audioPattern, sizeof(audioPattern));
+	events = 0;
+
+	//the restored frame has to be presented even if it matches an older generation
+	++frameGeneration;
+
+	return true;
+}
@@ -1,150 +1,492 @@
+#pragma once
+
+#include <cstddef>
 #include <cstdint>
-#include <random>
+#include <memory>
+#include <vector>
+#include "Quirks.hpp"
+#include "Random.hpp"
+#include "Scheduler.hpp"
+#if defined(CHIP8_PROFILE)
+#include "Profiler.hpp"
+#endif
 
 const unsigned int KEY_COUNT = 16;
-const unsigned int MEMORY_SIZE = 4096;
+const unsigned int MEMORY_SIZE = 4096;// CHIP-8 and SUPER-CHIP address space
+const unsigned int XO_MEMORY_SIZE = 65536;// XO-CHIP address space
 const unsigned int REGISTER_COUNT = 16;
 const unsigned int STACK_LEVELS = 16;
 const unsigned int VIDEO_HEIGHT = 32;
 const unsigned int VIDEO_WIDTH = 64;
+const unsigned int HIRES_VIDEO_HEIGHT = 64;// SUPER-CHIP 128x64 mode
+const unsigned int HIRES_VIDEO_WIDTH = 128;
+const unsigned int VIDEO_WORDS = HIRES_VIDEO_HEIGHT * HIRES_VIDEO_WIDTH / 64;// framebuffer size in 64-bit words, for either mode
+const unsigned int START_ADDRESS = 0x200;
+const unsigned int FONTSET_START_ADDRESS = 0x50;
+const unsigned int FONTSET_SIZE = 80;
+const unsigned int BIG_FONTSET_START_ADDRESS = 0xA0;
+const unsigned int BIG_FONTSET_SIZE = 160;
+const unsigned int RPL_FLAG_COUNT = 16;
+const unsigned int PLANE_COUNT = 2;// XO-CHIP bitplanes; the other dialects only draw on plane 0
+const unsigned int AUDIO_PATTERN_SIZE = 16;// XO-CHIP audio pattern, 128 one-bit samples
+const uint8_t DEFAULT_PITCH = 64;// pattern played at 4000 samples a second
+
+// XO-CHIP pattern bits played a second at a pitch set by Fx3A
+double PatternRate(uint8_t pitch);
+
+// Hex digit sprites 0-F, five bytes each, loaded at FONTSET_START_ADDRESS
+extern uint8_t fontset[FONTSET_SIZE];
+// SUPER-CHIP 8x10 hex digits for Fx30, ten bytes each, loaded at BIG_FONTSET_START_ADDRESS
+extern uint8_t bigFontset[BIG_FONTSET_SIZE];
+
+// Events that end a RunCycles/RunFrame batch early, reported in RunResult::events
+const uint32_t EVENT_DRAW = 1u << 0;// 00E0 or Dxyn changed the display
+const uint32_t EVENT_KEY_WAIT = 1u << 1;// Fx0A is waiting for a key
+const uint32_t EVENT_SOUND_START = 1u << 2;// Fx18 started the sound timer
+const uint32_t EVENT_FRAME_END = 1u << 3;// RunFrame reached the next 60 Hz timer tick
+
+struct RunResult{
+    unsigned int cycles;// instructions executed
+    uint32_t events;
+};
+
+// Interpreter backends, chosen when the Chip8 is constructed
+enum class Backend{
+    Table,// pointer-to-member tables over the predecoded instruction cache
+    Switch,// dense switch with the machine registers held in locals
+    Jit// x86-64 basic-block compiler, falls back to Table on other hosts
+};
+
+const uint32_t MACHINE_STATE_MAGIC = 0x54533843;// "C8ST" in little-endian byte order
+const uint32_t MACHINE_STATE_VERSION = 5;
+
+// Complete machine state as plain data. The layout is the binary format: fixed
+// width fields, widest first, no implicit padding, host byte order (little-endian
+// on every target this builds for). Add fields only by bumping the version.
+struct MachineState{
+    uint32_t magic;
+    uint32_t version;
+    SchedulerState scheduler;
+    uint64_t rngState;
+    uint64_t video[PLANE_COUNT][VIDEO_WORDS];
+    uint16_t stack[STACK_LEVELS];
+    uint16_t pc;
+    uint16_t index;
+    uint8_t registers[REGISTER_COUNT];
+    uint8_t keypad[KEY_COUNT];
+    uint8_t sp;
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t rngSource;// RandomSource
+    uint8_t rplFlags[RPL_FLAG_COUNT];
+    uint8_t hires;
+    uint8_t planes;// XO-CHIP plane mask
+    uint8_t pitch;
+    uint8_t quirks;// QuirkProfile of the machine that saved it
+    uint8_t reserved[4];// zero
+    uint8_t audioPattern[AUDIO_PATTERN_SIZE];
+    uint8_t memory[XO_MEMORY_SIZE];
+};
+
+static_assert(sizeof(MachineState) == 67760, "MachineState layout is the snapshot format");
+
+// Bytes of a state that hold it: everything ahead of memory plus the memory its quirk
+// profile addresses, 4 KB outside XO-CHIP. Save leaves the rest of memory as it was
+// and Load ignores it, so snapshots can be copied, compared and stored at this size
+inline size_t MachineStateSize(MachineState const& state){
+    bool xoChip = state.quirks == static_cast<uint8_t>(QuirkProfile::XoChip);
+    return offsetof(MachineState, memory) + (xoChip ? XO_MEMORY_SIZE : MEMORY_SIZE);
+}
+
+class Jit;
+class TraceWriter;
 
 class Chip8{
     public:
-        Chip8();
-        void LoadROM(char const* filename);
+        Chip8(Backend backend = Backend::Table);
+        ~Chip8();
+        bool LoadROM(char const* filename);
+        // Loads a ROM image already in memory; anything past the end of XO-CHIP's 64 KB is
+        // dropped, and the other profiles only address the first 4 KB of it
+        void LoadROM(uint8_t const* data, size_t size);
         void Cycle();
+        // Runs up to n cycles, returning early after an instruction raises an event;
+        // same results as calling Cycle() that many times. With idle skipping, a key
+        // wait runs out the batch before it is reported, since no key can change
+        // until the caller has control again
+        RunResult RunCycles(unsigned int n);
+        // Runs until the next 60 Hz timer tick; a frame cut short by an event
+        // is resumed by the next call
+        RunResult RunFrame();
+        // Sets the clock to instructionsPerFrame * 60 Hz and runs a frame
+        RunResult RunFrame(unsigned int instructionsPerFrame);
+        // Emulated CPU clock rate; the timers keep ticking at 60 Hz of emulated time
+        void SetClockHz(uint32_t clockHz);
+        // Emulated clock, for tracing and pacing
+        Scheduler const& GetScheduler() const { return scheduler; }
+        // Picks and seeds the generator behind Cxkk; a fresh machine uses
+        // RandomSource::Pcg seeded from the clock
+        void SetRandom(RandomSource source, uint64_t seed);
+        // Reseeds the current generator
+        void SetSeed(uint64_t seed) { SetRandom(random.Source(), seed); }
+        // The seed in effect since power-on or the last SetRandom, for recording a run
+        uint64_t Seed() const { return seed; }
+        RandomSource GetRandomSource() const { return random.Source(); }
+        // Switches the handlers to another dialect's quirks, dropping every cached
+        // decode and compiled block; a fresh machine runs QuirkProfile::Default
+        void SetQuirks(QuirkProfile profile);
+        QuirkProfile GetQuirks() const { return quirks; }
+        // Changes whenever an instruction writes to video, so unchanged frames need not be presented
+        uint32_t FrameGeneration() const { return frameGeneration; }
+        // SUPER-CHIP 128x64 mode, entered with 00FF and left with 00FE
+        bool HighResolution() const { return hires; }
+        unsigned int VideoWidth() const { return hires ? HIRES_VIDEO_WIDTH : VIDEO_WIDTH; }
+        unsigned int VideoHeight() const { return hires ? HIRES_VIDEO_HEIGHT : VIDEO_HEIGHT; }
+        // Words of video in use in the current mode
+        unsigned int VideoWords() const { return hires ? VIDEO_WORDS : VIDEO_HEIGHT; }
+        // Fx75/Fx85 storage, which survives loading another ROM like the HP-48's RPL flags
+        uint8_t const* RplFlags() const { return rplFlags; }
+        // Bitplanes making up the picture: video[0] alone, or both for XO-CHIP, where the
+        // pixel's colour is palette index plane 0 bit + 2 * plane 1 bit
+        unsigned int VideoPlanes() const { return quirks == QuirkProfile::XoChip ? PLANE_COUNT : 1u; }
+        // Bytes the current profile addresses, 4 KB or XO-CHIP's 64 KB
+        unsigned int MemorySize() const { return addressMask + 1u; }
+        // XO-CHIP sound: while the sound timer runs, the 128 bits F002 loaded are played
+        // in a loop, most significant bit of byte 0 first, at PatternRate() bits a second
+        uint8_t const* AudioPattern() const { return audioPattern; }
+        uint8_t Pitch() const { return pitch; }
+        double PatternRate() const;
+
+        // Read-only view of the machine, for tools and tests
+        uint8_t const* Registers() const { return registers; }
+        uint16_t PC() const { return pc; }
+        uint16_t Index() const { return index; }
+        uint8_t SP() const { return sp; }
+        uint8_t DelayTimer() const { return delayTimer; }
+        uint8_t SoundTimer() const { return soundTimer; }
+        // Snapshots of the whole machine; Load returns false for a state from another format version
+        void Save(MachineState& state) const;
+        bool Load(MachineState const& state);
+#if defined(CHIP8_PROFILE)
+        // Counts for every instruction executed since construction; the Jit backend
+        // runs as Table in profiling builds so nothing escapes the counters
+        Profiler const& GetProfiler() const { return profiler; }
+        void ClearProfile() { profiler.Clear(); }
+#endif
+        // Records every instruction into writer until SetTrace(nullptr); while tracing,
+        // every backend runs the table interpreter so each instruction is seen
+        void SetTrace(TraceWriter* writer) { trace = writer; }
+        // Idle loops are fast-forwarded instead of run instruction by instruction: Fx0A
+        // waiting for a key, 1nnn jumping to itself and 00FD to the end of the batch, and
+        // an Fx07, 3xkk or 4xkk, 1nnn loop polling the delay timer to the next timer
+        // tick. The machine ends up exactly as running them would have left it; only the
+        // instructions dispatched differ, so turn it off for exact instruction counts.
+        // On by default; never applies while tracing
+        void SetIdleSkip(bool enabled) { idleSkip = enabled; }
+        bool IdleSkip() const { return idleSkip; }
+        // Cycles fast-forwarded since construction
+        uint64_t IdleCycles() const { return idleCycles; }
+        // Jit backend only: cross-check every compiled block against the interpreter
+        void SetJitVerify(bool enabled);
+        unsigned long long JitMismatches() const;
+
+        // The instructions Decode tells apart, named after their handlers
+        enum class Op : uint8_t{
+            OP_NULL,// no instruction; runs as a no-op
+            OP_00Cn, OP_00E0, OP_00EE, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF,
+            OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, OP_5xy2, OP_5xy3, OP_6xkk, OP_7xkk,
+            OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4, OP_8xy5, OP_8xy6, OP_8xy7, OP_8xyE,
+            OP_9xy0, OP_Annn, OP_Bnnn, OP_Cxkk, OP_Dxyn, OP_Ex9E, OP_ExA1,
+            OP_F000, OP_Fn01, OP_F002, OP_Fx07, OP_Fx0A, OP_Fx15, OP_Fx18, OP_Fx1E, OP_Fx29,
+            OP_Fx30, OP_Fx33, OP_Fx3A, OP_Fx55, OP_Fx65, OP_Fx75, OP_Fx85,
+            COUNT// not an instruction: how many there are
+        };
+        // Which instruction opcode is with or without the SUPER-CHIP and XO-CHIP ones. The
+        // handler tables are filled from this, so tools that name opcodes by it, like the
+        // disassembler, see every opcode the way it runs
+        static Op DecodeOp(uint16_t opcode, bool superChip, bool xoChip);
 
         uint8_t keypad[KEY_COUNT]{};
-        uint32_t video[VIDEO_WIDTH * VIDEO_HEIGHT]{};
+        // Packed 1bpp rows per plane, column 0 in the most significant bit: one 64-bit word
+        // per row for VIDEO_HEIGHT rows, or two per row for HIRES_VIDEO_HEIGHT rows in 128x64 mode
+        uint64_t video[PLANE_COUNT][VIDEO_WORDS]{};
 
     private:
-        void Table0();
-        void Table8();
-        void TableE();
-        void TableF();
+        friend class Jit;
+
+        struct Instruction;
+        typedef void  (Chip8::*Chip8Func)(Instruction const&);
+
+        // An instruction decoded once and cached per address: the resolved
+        // handler plus the operand fields every handler would otherwise
+        // re-extract from the opcode
+        struct Instruction{
+            Chip8Func handler;// nullptr while the slot has not been decoded
+            uint16_t opcode;
+            uint16_t nnn;
+            uint8_t x;
+            uint8_t y;
+            uint8_t kk;
+            uint8_t n;
+        };
+
+        // Returns the cached instruction at address, decoding it on first use
+        Instruction const& Fetch(uint16_t address);
+        void Decode(Instruction& slot, uint16_t address);
+        // Drops cached decodes overlapping memory[address, address + length), wrapping at the end of memory
+        void Invalidate(uint16_t address, unsigned int length);
+
+        // Executes one instruction without touching the timers
+        void Step();
+        // Accounts for cycles executed, ticking the timers for every 60 Hz tick that fell due
+        void AdvanceTimers(unsigned int cycles);
+        void TickTimers(unsigned int ticks);
+
+        // True when the 1nnn at jump, going to target, closes an idle loop with the delay timer at dt
+        bool IsIdleLoop(uint16_t jump, uint16_t target, uint8_t dt) const;
+        // Fast-forwards the idle loop at pc by up to n cycles, returning the cycles skipped
+        unsigned int SkipIdle(unsigned int n);
+
+        // Table interpreter loop that records each instruction into trace
+        unsigned int RunTraced(unsigned int n);
+        // Switch backend, defined in Chip8Switch.cpp: picks the loop compiled for the current quirks
+        unsigned int RunSwitch(unsigned int n);
+        template<typename Quirks>
+        unsigned int RunSwitchLoop(unsigned int n);
+        // Points the handler tables at DecodeOp's instructions, compiled for Quirks
+        template<typename Quirks>
+        void UseQuirks();
+        template<typename Quirks>
+        static Chip8Func Handler(Op op);
+        // Bytes a skip passes over: the next instruction, which on XO-CHIP can be the four byte F000 nnnn
+        template<typename Quirks>
+        unsigned int SkipLength(uint16_t address) const{
+            if (Quirks::xoChip && memory[address & addressMask] == 0xF0 && memory[(address + 1u) & addressMask] == 0x00){
+                return 4;
+            }
+            return 2;
+        }
+        // Draws on every plane the mask selects, each plane's rows following the last's in memory
+        uint8_t DrawPlanes(uint16_t address, uint8_t x, uint8_t y, uint8_t height, bool wrap);
+        // Sprites clipped at the edges of the screen, or wrapped round to the far side
+        uint8_t DrawSprite(unsigned int plane, uint16_t address, uint8_t x, uint8_t y, uint8_t height);
+        uint8_t DrawSpriteWrapped(unsigned int plane, uint16_t address, uint8_t x, uint8_t y, uint8_t height);
+        // The SUPER-CHIP cases: any sprite in 128x64 mode, and 16x16 sprites (height 0) in either
+        uint8_t DrawSpriteExtended(unsigned int plane, uint16_t address, uint8_t x, uint8_t y, uint8_t height, bool wrap);
+        // Scrolls the selected planes by whole pixels of the current mode, shifting in blank ones
+        void ScrollDown(unsigned int rows);
+        void ScrollRight(unsigned int columns);
+        void ScrollLeft(unsigned int columns);
+        // Switches between 64x32 and 128x64, clearing every plane
+        void SetHighResolution(bool enabled);
+        // Clears the selected planes
+        void ClearScreen();
 
         // Do nothing
-        void OP_NULL();
+        void OP_NULL(Instruction const& instruction);
+
+        // SCD nibble
+        void OP_00Cn(Instruction const& instruction);
 
         // CLS
-        void OP_00E0();
+        void OP_00E0(Instruction const& instruction);
 
         // RET
-        void OP_00EE();
+        void OP_00EE(Instruction const& instruction);
+
+        // SCR
+        void OP_00FB(Instruction const& instruction);
+
+        // SCL
+        void OP_00FC(Instruction const& instruction);
+
+        // EXIT
+        void OP_00FD(Instruction const& instruction);
+
+        // LOW
+        void OP_00FE(Instruction const& instruction);
+
+        // HIGH
+        void OP_00FF(Instruction const& instruction);
 
         // JP address
-        void OP_1nnn();
+        void OP_1nnn(Instruction const& instruction);
 
         // CALL address
-        void OP_2nnn();
+        void OP_2nnn(Instruction const& instruction);
 
         // SE Vx, byte
-        void OP_3xkk();
+        template<typename Quirks>
+        void OP_3xkk(Instruction const& instruction);
 
         // SNE Vx, byte
-        void OP_4xkk();
+        template<typename Quirks>
+        void OP_4xkk(Instruction const& instruction);
 
         // SE Vx, Vy
-        void OP_5xy0();
+        template<typename Quirks>
+        void OP_5xy0(Instruction const& instruction);
+
+        // SAVE Vx - Vy
+        void OP_5xy2(Instruction const& instruction);
+
+        // LOAD Vx - Vy
+        void OP_5xy3(Instruction const& instruction);
 
         // LD Vx, byte
-        void OP_6xkk();
+        void OP_6xkk(Instruction const& instruction);
 
         // ADD Vx, byte
-        void OP_7xkk();
+        void OP_7xkk(Instruction const& instruction);
 
         // LD Vx, Vy
-        void OP_8xy0();
+        void OP_8xy0(Instruction const& instruction);
 
         // OR Vx, Vy
-        void OP_8xy1();
+        template<typename Quirks>
+        void OP_8xy1(Instruction const& instruction);
 
         // AND Vx, Vy
-        void OP_8xy2();
+        template<typename Quirks>
+        void OP_8xy2(Instruction const& instruction);
 
         // XOR Vx, Vy
-        void OP_8xy3();
+        template<typename Quirks>
+        void OP_8xy3(Instruction const& instruction);
 
         // ADD Vx, Vy
-        void OP_8xy4();
+        void OP_8xy4(Instruction const& instruction);
 
         // SUB Vx, Vy
-        void OP_8xy5();
+        void OP_8xy5(Instruction const& instruction);
 
         // SHR Vx
-        void OP_8xy6();
+        template<typename Quirks>
+        void OP_8xy6(Instruction const& instruction);
 
         // SUBN Vx, Vy
-        void OP_8xy7();
+        void OP_8xy7(Instruction const& instruction);
 
         // SHL Vx
-        void OP_8xyE();
+        template<typename Quirks>
+        void OP_8xyE(Instruction const& instruction);
 
         // SNE Vx, Vy
-        void OP_9xy0();
+        template<typename Quirks>
+        void OP_9xy0(Instruction const& instruction);
 
         // LD I, address
-        void OP_Annn();
+        void OP_Annn(Instruction const& instruction);
 
         // JP V0, address
-        void OP_Bnnn();
+        template<typename Quirks>
+        void OP_Bnnn(Instruction const& instruction);
 
         // RND Vx, byte
-        void OP_Cxkk();
+        void OP_Cxkk(Instruction const& instruction);
 
         // DRW Vx, Vy, height
-        void OP_Dxyn();
+        template<typename Quirks>
+        void OP_Dxyn(Instruction const& instruction);
 
         // SKP Vx
-        void OP_Ex9E();
+        template<typename Quirks>
+        void OP_Ex9E(Instruction const& instruction);
 
         // SKNP Vx
-        void OP_ExA1();
+        template<typename Quirks>
+        void OP_ExA1(Instruction const& instruction);
+
+        // LD I, long address
+        void OP_F000(Instruction const& instruction);
+
+        // PLANE n
+        void OP_Fn01(Instruction const& instruction);
+
+        // AUDIO
+        void OP_F002(Instruction const& instruction);
 
         // LD Vx, DT
-        void OP_Fx07();
+        void OP_Fx07(Instruction const& instruction);
 
         // LD Vx, K
-        void OP_Fx0A();
+        void OP_Fx0A(Instruction const& instruction);
 
         // LD DT, Vx
-        void OP_Fx15();
+        void OP_Fx15(Instruction const& instruction);
 
         // LD ST, Vx
-        void OP_Fx18();
+        void OP_Fx18(Instruction const& instruction);
 
         // ADD I, Vx
-        void OP_Fx1E();
+        void OP_Fx1E(Instruction const& instruction);
 
         // LD F, Vx
-        void OP_Fx29();
+        void OP_Fx29(Instruction const& instruction);
+
+        // LD HF, Vx
+        void OP_Fx30(Instruction const& instruction);
 
         // LD B, Vx
-        void OP_Fx33();
+        void OP_Fx33(Instruction const& instruction);
+
+        // PITCH Vx
+        void OP_Fx3A(Instruction const& instruction);
 
         // LD [I], Vx
-        void OP_Fx55();
+        template<typename Quirks>
+        void OP_Fx55(Instruction const& instruction);
 
         // LD Vx, [I]
-        void OP_Fx65();
+        template<typename Quirks>
+        void OP_Fx65(Instruction const& instruction);
+
+        // LD R, Vx
+        void OP_Fx75(Instruction const& instruction);
+
+        // LD Vx, R
+        void OP_Fx85(Instruction const& instruction);
 
         uint8_t registers[16]{};
-        uint8_t memory[4096]{};
+        uint8_t memory[XO_MEMORY_SIZE]{};
+        uint16_t addressMask{MEMORY_SIZE - 1u};// addresses wrap at the end of the profile's memory
         uint16_t index{};
         uint16_t pc{};
         uint16_t stack[16]{};
         uint8_t sp{};
         uint8_t delayTimer{};
         uint8_t soundTimer{};
-        uint16_t opcode {};
-
-        std::default_random_engine randGen;//delcaring a random number generator engine to create pusedo-random numbers
-        std::uniform_int_distribution<uint8_t> randByte;//delcaring a uniform integer distribution to genereate numbers from 0 to 255
+        bool hires{};
+        uint8_t rplFlags[RPL_FLAG_COUNT]{};
+        uint8_t planeMask{1};// planes Dxyn, 00E0 and the scrolls act on, set by Fn01
+        uint8_t audioPattern[AUDIO_PATTERN_SIZE]{};
+        uint8_t pitch{DEFAULT_PITCH};
+        Backend backend;
+        QuirkProfile quirks{QuirkProfile::Default};
+        Scheduler scheduler;
+        uint32_t events{};// raised by the handlers during the current batch
+        // Raised with the events when a jump closes an idle loop; RunCycles skips it and never reports it
+        static const uint32_t EVENT_IDLE_LOOP = 1u << 31;
+        bool idleSkip{true};
+        uint64_t idleCycles{};
+        uint32_t frameGeneration{};
+        std::unique_ptr<Jit> jit;
+        TraceWriter* trace{};
+
+        uint64_t seed{};
+        RandomByte random;//random bytes for Cxkk
+#if defined(CHIP8_PROFILE)
+        Profiler profiler;
+#endif
     
-        typedef void  (Chip8::*Chip8Func)();
         Chip8Func table[0xF + 1];
-        Chip8Func table0[0xE + 1];
-        Chip8Func table8[0xE + 1];
-        Chip8Func tableE[0xE + 1];
-        Chip8Func tableF[0x65 + 1];
+        Chip8Func table0[0xFF + 1];
+        Chip8Func table5[0xF + 1];
+        Chip8Func table8[0xF + 1];
+        Chip8Func tableE[0xF + 1];
+        Chip8Func tableF[0xFF + 1];
+
+        // one slot per byte address since pc is not required to stay even, for as
+        // much memory as the profile addresses so 4 KB machines stay small
+        std::vector<Instruction> decoded;
     };
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include <cstdint>
+#include <cstring>
+#include "Chip8.hpp"
+
+//the loop is compiled once per quirk policy, so picking one here is the only
+//test of the quirks the switch backend makes
+unsigned int Chip8::RunSwitch(unsigned int n){
+	switch (quirks){
+		case QuirkProfile::Vip: return RunSwitchLoop<VipQuirks>(n);
+		case QuirkProfile::Chip48: return RunSwitchLoop<Chip48Quirks>(n);
+		case QuirkProfile::Schip: return RunSwitchLoop<SchipQuirks>(n);
+		case QuirkProfile::XoChip: return RunSwitchLoop<XoChipQuirks>(n);
+		default: return RunSwitchLoop<DefaultQuirks>(n);
+	}
+}
+
+//switch backend: the same instruction set as the OP_* handlers, but decoded with
+//a dense switch and with every register held in a local for the whole run, so
+//there is no member-pointer call per instruction and no reload of machine state
+template<typename Quirks>
+unsigned int Chip8::RunSwitchLoop(unsigned int n){
+	uint8_t V[REGISTER_COUNT];
+	memcpy(V, registers, sizeof(V));
+
+	uint16_t PC = pc;
+	uint16_t I = index;
+	uint8_t SP = sp;
+	uint8_t DT = delayTimer;
+	uint8_t ST = soundTimer;
+	unsigned int untilTick = scheduler.CyclesUntilTick();
+	unsigned int unsynced = 0;// cycles not yet reported to the scheduler
+	uint32_t raised = 0;
+	//addresses wrap at the end of the profile's memory, as addressMask
+	const uint16_t mask = Quirks::xoChip ? XO_MEMORY_SIZE - 1u : MEMORY_SIZE - 1u;
+
+	unsigned int cycle = 0;
+
+	while (cycle < n && !raised){
+		//fetch
+		uint16_t opcode = (memory[PC & mask] << 8u) | memory[(PC + 1u) & mask];
+		uint8_t x = (opcode & 0x0F00u) >> 8u;
+		uint8_t y = (opcode & 0x00F0u) >> 4u;
+		uint8_t kk = opcode & 0x00FFu;
+		uint16_t nnn = opcode & 0x0FFFu;
+
+#if defined(CHIP8_PROFILE)
+		uint16_t address = PC;
+		uint64_t start = Profiler::Now();
+#endif
+
+		PC += 2;
+
+		//decode and execute
+		switch ((opcode & 0xF000u) >> 12u){
+			case 0x0:
+				if (Quirks::superChip){
+					//the whole low byte, as in UseQuirks
+					switch (kk){
+						case 0xE0: ClearScreen(); raised |= EVENT_DRAW; break;
+						case 0xEE: SP = (SP - 1u) & (STACK_LEVELS - 1u); PC = stack[SP]; break;
+						case 0xFB: ScrollRight(4); raised |= EVENT_DRAW; break;
+						case 0xFC: ScrollLeft(4); raised |= EVENT_DRAW; break;
+						case 0xFD: PC -= 2; raised |= idleSkip ? EVENT_IDLE_LOOP : 0u; break;
+						case 0xFE: SetHighResolution(false); raised |= EVENT_DRAW; break;
+						case 0xFF: SetHighResolution(true); raised |= EVENT_DRAW; break;
+						default:
+							if ((kk & 0xF0u) == 0xC0u){
+								ScrollDown(kk & 0x0Fu);
+								raised |= EVENT_DRAW;
+							}
+							break;
+					}
+					break;
+				}
+
+				switch (opcode & 0x000Fu){
+					case 0x0: ClearScreen(); raised |= EVENT_DRAW; break;
+					case 0xE: SP = (SP - 1u) & (STACK_LEVELS - 1u); PC = stack[SP]; break;
+					default: break;
+				}
+				break;
+
+			case 0x1:
+				//a jump closing an idle loop ends the run so RunCycles can skip it, as in OP_1nnn
+				if (idleSkip && (nnn == PC - 2u || nnn + 4u == PC - 2u) && IsIdleLoop(PC - 2u, nnn, DT)){
+					raised |= EVENT_IDLE_LOOP;
+				}
+				PC = nnn;
+				break;
+			case 0x2: stack[SP] = PC; SP = (SP + 1u) & (STACK_LEVELS - 1u); PC = nnn; break;
+			case 0x3: if (V[x] == kk) PC += SkipLength<Quirks>(PC); break;
+			case 0x4: if (V[x] != kk) PC += SkipLength<Quirks>(PC); break;
+
+			case 0x5:
+				if (Quirks::xoChip){
+					//5xy2 and 5xy3 store and load Vx to Vy, counting down when x > y
+					int step = x <= y ? 1 : -1;
+					unsigned int count = (x <= y ? y - x : x - y) + 1u;
+
+					switch (opcode & 0x000Fu){
+						case 0x0: if (V[x] == V[y]) PC += SkipLength<Quirks>(PC); break;
+						case 0x2:
+							for (unsigned int i = 0; i < count; ++i){
+								memory[(I + i) & mask] = V[x + step * int(i)];
+							}
+							Invalidate(I, count);
+							break;
+						case 0x3:
+							for (unsigned int i = 0; i < count; ++i){
+								V[x + step * int(i)] = memory[(I + i) & mask];
+							}
+							break;
+						default: break;
+					}
+					break;
+				}
+
+				if (V[x] == V[y]) PC += SkipLength<Quirks>(PC);
+				break;
+
+			case 0x6: V[x] = kk; break;
+			case 0x7: V[x] += kk; break;
+
+			case 0x8:
+				switch (opcode & 0x000Fu){
+					case 0x0: V[x] = V[y]; break;
+					case 0x1: V[x] |= V[y]; if (Quirks::resetVf) V[0xF] = 0; break;
+					case 0x2: V[x] &= V[y]; if (Quirks::resetVf) V[0xF] = 0; break;
+					case 0x3: V[x] ^= V[y]; if (Quirks::resetVf) V[0xF] = 0; break;
+					case 0x4:{
+						uint16_t sum = V[x] + V[y];
+						V[0xF] = sum > 255U ? 1 : 0;
+						V[x] = sum & 0xFFu;
+					} break;
+					case 0x5:
+						V[0xF] = V[x] > V[y] ? 1 : 0;
+						V[x] -= V[y];
+						break;
+					case 0x6:
+						V[0xF] = V[Quirks::shiftVy ? y : x] & 0x1u;
+						V[x] = V[Quirks::shiftVy ? y : x] >> 1;
+						break;
+					case 0x7:
+						V[0xF] = V[y] > V[x] ? 1 : 0;
+						V[x] = V[y] - V[x];
+						break;
+					case 0xE:
+						V[0xF] = (V[Quirks::shiftVy ? y : x] & 0x80u) >> 7u;
+						V[x] = V[Quirks::shiftVy ? y : x] << 1;
+						break;
+					default: break;
+				}
+				break;
+
+			case 0x9: if (V[x] != V[y]) PC += SkipLength<Quirks>(PC); break;
+			case 0xA: I = nnn; break;
+			case 0xB: PC = V[Quirks::jumpVx ? x : 0] + nnn; break;
+			case 0xC: V[x] = random.Next() & kk; break;
+
+			case 0xD:
+				if (Quirks::xoChip){
+					V[0xF] = DrawPlanes(I, V[x], V[y], opcode & 0x000Fu, Quirks::wrapSprites);
+				}else if (Quirks::superChip && (hires || (opcode & 0x000Fu) == 0)){
+					V[0xF] = DrawSpriteExtended(0, I, V[x], V[y], opcode & 0x000Fu, Quirks::wrapSprites);
+				}else if (Quirks::wrapSprites){
+					V[0xF] = DrawSpriteWrapped(0, I, V[x], V[y], opcode & 0x000Fu);
+				}else{
+					V[0xF] = DrawSprite(0, I, V[x], V[y], opcode & 0x000Fu);
+				}
+				raised |= EVENT_DRAW;
+				break;
+
+			case 0xE:
+				switch (opcode & 0x000Fu){
+					case 0xE: if (keypad[V[x] & (KEY_COUNT - 1u)]) PC += SkipLength<Quirks>(PC); break;
+					case 0x1: if (!keypad[V[x] & (KEY_COUNT - 1u)]) PC += SkipLength<Quirks>(PC); break;
+					default: break;
+				}
+				break;
+
+			case 0xF:
+				switch (kk){
+					case 0x00:
+						//F000 nnnn, the word after it loaded into I
+						if (Quirks::xoChip && x == 0){
+							I = (memory[PC & mask] << 8u) | memory[(PC + 1u) & mask];
+							PC += 2;
+						}
+						break;
+					case 0x01: if (Quirks::xoChip) planeMask = x & ((1u << PLANE_COUNT) - 1u); break;
+					case 0x02:
+						if (Quirks::xoChip){
+							for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; ++i){
+								audioPattern[i] = memory[(I + i) & mask];
+							}
+						}
+						break;
+					case 0x07: V[x] = DT; break;
+					case 0x0A:{
+						//lowest pressed key wins, as in OP_Fx0A
+						uint64_t low, high;
+						memcpy(&low, keypad, sizeof(low));
+						memcpy(&high, keypad + 8, sizeof(high));
+
+						if (!(low | high)){
+							PC -= 2;
+							raised |= EVENT_KEY_WAIT;
+							break;
+						}
+
+						unsigned int key = 0;
+						while (!keypad[key]){
+							++key;
+						}
+						V[x] = key;
+					} break;
+					case 0x15: DT = V[x]; break;
+					case 0x18:
+						if (ST == 0 && V[x] > 0){
+							raised |= EVENT_SOUND_START;
+						}
+						ST = V[x];
+						break;
+					case 0x1E: I += V[x]; break;
+					case 0x29: I = FONTSET_START_ADDRESS + (5 * V[x]); break;
+					case 0x30: if (Quirks::superChip) I = BIG_FONTSET_START_ADDRESS + (10 * (V[x] & 0xFu)); break;
+					case 0x33:
+						memory[(I + 2) & mask] = V[x] % 10;
+						memory[(I + 1) & mask] = (V[x] / 10) % 10;
+						memory[I & mask] = (V[x] / 100) % 10;
+						Invalidate(I, 3);
+						break;
+					case 0x3A: if (Quirks::xoChip) pitch = V[x]; break;
+					case 0x55:
+						for (uint8_t i = 0; i <= x; ++i){
+							memory[(I + i) & mask] = V[i];
+						}
+						Invalidate(I, x + 1u);
+						I += Quirks::indexIncrement == IndexIncrement::XPlusOne ? x + 1u : Quirks::indexIncrement == IndexIncrement::X ? x : 0u;
+						break;
+					case 0x65:
+						for (uint8_t i = 0; i <= x; ++i){
+							V[i] = memory[(I + i) & mask];
+						}
+						I += Quirks::indexIncrement == IndexIncrement::XPlusOne ? x + 1u : Quirks::indexIncrement == IndexIncrement::X ? x : 0u;
+						break;
+					case 0x75: if (Quirks::superChip) memcpy(rplFlags, V, x + 1u); break;
+					case 0x85: if (Quirks::superChip) memcpy(V, rplFlags, x + 1u); break;
+					default: break;
+				}
+				break;
+		}
+
+#if defined(CHIP8_PROFILE)
+		profiler.Record(address, opcode, Profiler::Now() - start);
+#endif
+
+		++cycle;
+		++unsynced;
+
+		//timers tick when the scheduler says a 60 Hz tick is due, as in AdvanceTimers()
+		if (--untilTick == 0){
+			unsigned int ticks = scheduler.Advance(unsynced);
+			unsynced = 0;
+			untilTick = scheduler.CyclesUntilTick();
+
+			DT = DT > ticks ? DT - ticks : 0;
+			ST = ST > ticks ? ST - ticks : 0;
+		}
+	}
+
+	scheduler.Advance(unsynced);
+
+	memcpy(registers, V, sizeof(V));
+	pc = PC;
+	index = I;
+	sp = SP;
+	delayTimer = DT;
+	soundTimer = ST;
+	events |= raised;
+
+	return cycle;
+}
@@ -0,0 +1,64 @@
+#include "Disassembler.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Disassembles a ROM by following its control flow from START_ADDRESS: a listing
+// of its basic blocks and data by default, or the control-flow graph in Graphviz
+// dot format with --dot (render with e.g. dot -Tsvg)
+int main(int argc, char** argv)
+{
+	char const* romFilename = nullptr;
+	QuirkProfile quirks = QuirkProfile::Default;
+	bool dot = false;
+	bool usage = false;
+
+	for (int i = 1; i < argc && !usage; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--dot")
+		{
+			dot = true;
+		}
+		else if (arg == "--quirks" && hasValue)
+		{
+			usage = !ParseQuirkProfile(argv[++i], quirks);
+		}
+		else if (!romFilename && arg[0] != '-')
+		{
+			romFilename = argv[i];
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	if (usage || !romFilename)
+	{
+		std::cerr << "Usage: " << argv[0] << " <ROM> [--quirks default|vip|chip48|schip|xochip] [--dot]\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	ControlFlowGraph graph;
+	graph.SetQuirks(quirks);
+
+	if (!graph.LoadROM(romFilename))
+	{
+		std::cerr << "Cannot read ROM " << romFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	if (dot)
+	{
+		graph.WriteGraphviz(std::cout);
+	}
+	else
+	{
+		graph.WriteText(std::cout);
+	}
+
+	return 0;
+}
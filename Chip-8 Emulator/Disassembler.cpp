@@ -0,0 +1,697 @@
+#include "Disassembler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <vector>
+
+namespace
+{
+	typedef Chip8::Op Op;
+
+	// Mnemonic and flow of each instruction Chip8::DecodeOp tells apart
+	struct OpcodeTable
+	{
+		OpcodeInfo info[static_cast<size_t>(Op::COUNT)];
+
+		void Set(Op op, char const* format, Flow flow)
+		{
+			info[static_cast<size_t>(op)] = { format, flow };
+		}
+
+		OpcodeTable()
+		{
+			Set(Op::OP_NULL, "??? {nnn}", Flow::Invalid);
+			Set(Op::OP_00Cn, "SCD {n}", Flow::Next);
+			Set(Op::OP_00E0, "CLS", Flow::Next);
+			Set(Op::OP_00EE, "RET", Flow::Return);
+			Set(Op::OP_00FB, "SCR", Flow::Next);
+			Set(Op::OP_00FC, "SCL", Flow::Next);
+			Set(Op::OP_00FD, "EXIT", Flow::Exit);
+			Set(Op::OP_00FE, "LOW", Flow::Next);
+			Set(Op::OP_00FF, "HIGH", Flow::Next);
+			Set(Op::OP_1nnn, "JP {nnn}", Flow::Jump);
+			Set(Op::OP_2nnn, "CALL {nnn}", Flow::Call);
+			Set(Op::OP_3xkk, "SE V{x}, {kk}", Flow::Skip);
+			Set(Op::OP_4xkk, "SNE V{x}, {kk}", Flow::Skip);
+			Set(Op::OP_5xy0, "SE V{x}, V{y}", Flow::Skip);
+			Set(Op::OP_5xy2, "SAVE V{x} - V{y}", Flow::Next);
+			Set(Op::OP_5xy3, "LOAD V{x} - V{y}", Flow::Next);
+			Set(Op::OP_6xkk, "LD V{x}, {kk}", Flow::Next);
+			Set(Op::OP_7xkk, "ADD V{x}, {kk}", Flow::Next);
+			Set(Op::OP_8xy0, "LD V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xy1, "OR V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xy2, "AND V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xy3, "XOR V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xy4, "ADD V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xy5, "SUB V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xy6, "SHR V{x}", Flow::Next);
+			Set(Op::OP_8xy7, "SUBN V{x}, V{y}", Flow::Next);
+			Set(Op::OP_8xyE, "SHL V{x}", Flow::Next);
+			Set(Op::OP_9xy0, "SNE V{x}, V{y}", Flow::Skip);
+			Set(Op::OP_Annn, "LD I, {nnn}", Flow::Next);
+			Set(Op::OP_Bnnn, "JP V0, {nnn}", Flow::IndirectJump);
+			Set(Op::OP_Cxkk, "RND V{x}, {kk}", Flow::Next);
+			Set(Op::OP_Dxyn, "DRW V{x}, V{y}, {n}", Flow::Next);
+			Set(Op::OP_Ex9E, "SKP V{x}", Flow::Skip);
+			Set(Op::OP_ExA1, "SKNP V{x}", Flow::Skip);
+			// F000 is four bytes long, the address in the second word; the listing prints it
+			Set(Op::OP_F000, "LD I, long", Flow::Next);
+			Set(Op::OP_Fn01, "PLANE {x}", Flow::Next);
+			Set(Op::OP_F002, "AUDIO", Flow::Next);
+			Set(Op::OP_Fx07, "LD V{x}, DT", Flow::Next);
+			Set(Op::OP_Fx0A, "LD V{x}, K", Flow::Next);
+			Set(Op::OP_Fx15, "LD DT, V{x}", Flow::Next);
+			Set(Op::OP_Fx18, "LD ST, V{x}", Flow::Next);
+			Set(Op::OP_Fx1E, "ADD I, V{x}", Flow::Next);
+			Set(Op::OP_Fx29, "LD F, V{x}", Flow::Next);
+			Set(Op::OP_Fx30, "LD HF, V{x}", Flow::Next);
+			Set(Op::OP_Fx33, "LD B, V{x}", Flow::Next);
+			Set(Op::OP_Fx3A, "PITCH V{x}", Flow::Next);
+			Set(Op::OP_Fx55, "LD [I], V{x}", Flow::Next);
+			Set(Op::OP_Fx65, "LD V{x}, [I]", Flow::Next);
+			Set(Op::OP_Fx75, "LD R, V{x}", Flow::Next);
+			Set(Op::OP_Fx85, "LD V{x}, R", Flow::Next);
+		}
+	};
+
+	const OpcodeTable opcodeTable;
+
+	// Bytes per line for data nothing was seen reading
+	const unsigned int UNREACHED_BYTES_PER_LINE = 8;
+
+	std::string Hex(unsigned int value, int width)
+	{
+		char text[8];
+		snprintf(text, sizeof(text), "%0*X", width, value & 0xFFFFu);
+		return text;
+	}
+
+	std::string NodeName(uint16_t address)
+	{
+		return "b" + Hex(address, 3);
+	}
+}
+
+OpcodeInfo const& LookUpOpcode(uint16_t opcode, QuirkProfile profile)
+{
+	QuirkFlags flags = GetQuirkFlags(profile);
+	Op op = Chip8::DecodeOp(opcode, flags.superChip, flags.xoChip);
+	return opcodeTable.info[static_cast<size_t>(op)];
+}
+
+std::string Disassemble(uint16_t opcode, QuirkProfile profile)
+{
+	std::string text;
+
+	for (char const* c = LookUpOpcode(opcode, profile).format; *c; ++c)
+	{
+		if (*c != '{')
+		{
+			text += *c;
+			continue;
+		}
+
+		char const* close = strchr(c, '}');
+		std::string field(c + 1, close);
+		c = close;
+
+		if (field == "x") text += Hex((opcode & 0x0F00u) >> 8u, 1);
+		else if (field == "y") text += Hex((opcode & 0x00F0u) >> 4u, 1);
+		else if (field == "n") text += std::to_string(opcode & 0x000Fu);
+		else if (field == "kk") text += "0x" + Hex(opcode & 0x00FFu, 2);
+		else text += "0x" + Hex(opcode & 0x0FFFu, 3);
+	}
+
+	return text;
+}
+
+bool ControlFlowGraph::LoadROM(char const* filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	LoadROM(data.data(), data.size());
+
+	return true;
+}
+
+void ControlFlowGraph::LoadROM(uint8_t const* data, size_t size)
+{
+	// Same layout as Chip8::LoadROM: the font at FONTSET_START_ADDRESS, the ROM at START_ADDRESS, the rest
+	// cut off where the profile's memory ends
+	addressMask = GetQuirkFlags(quirks).xoChip ? XO_MEMORY_SIZE - 1u : MEMORY_SIZE - 1u;
+
+	if (size > addressMask + 1u - START_ADDRESS)
+	{
+		size = addressMask + 1u - START_ADDRESS;
+	}
+
+	memset(memory, 0, sizeof(memory));
+	memcpy(memory + FONTSET_START_ADDRESS, fontset, FONTSET_SIZE);
+	memcpy(memory + BIG_FONTSET_START_ADDRESS, bigFontset, BIG_FONTSET_SIZE);
+	memcpy(memory + START_ADDRESS, data, size);
+	romEnd = START_ADDRESS + static_cast<unsigned int>(size);
+
+	Analyze();
+}
+
+uint16_t ControlFlowGraph::Opcode(uint16_t address) const
+{
+	return (memory[address & addressMask] << 8u) | memory[(address + 1u) & addressMask];
+}
+
+unsigned int ControlFlowGraph::Length(uint16_t address) const
+{
+	return GetQuirkFlags(quirks).xoChip && Opcode(address) == 0xF000u ? 4u : 2u;
+}
+
+std::string ControlFlowGraph::Instruction(uint16_t address) const
+{
+	uint16_t opcode = Opcode(address);
+	std::string text = Disassemble(opcode, quirks);
+
+	if (Length(address) == 4u)
+	{
+		text += " 0x" + Hex(Opcode(static_cast<uint16_t>(address + 2u)), 4);
+	}
+
+	return text;
+}
+
+void ControlFlowGraph::Analyze()
+{
+	memset(flags, 0, sizeof(flags));
+	blocks.clear();
+
+	Trace();
+	BuildBlocks();
+	TraceIndex();
+}
+
+void ControlFlowGraph::MarkData(uint16_t address, unsigned int length)
+{
+	for (unsigned int i = 0; i < length; ++i)
+	{
+		flags[(address + i) & addressMask] |= DATA;
+	}
+}
+
+// Walks every path from START_ADDRESS, marking instructions as code and branch
+// targets as block leaders
+void ControlFlowGraph::Trace()
+{
+	// Instruction starts; CODE alone can't tell them from the second byte of an instruction
+	std::vector<bool> visited(addressMask + 1u);
+	std::vector<uint16_t> pending{ static_cast<uint16_t>(START_ADDRESS) };
+	flags[START_ADDRESS] |= LEADER;
+
+	auto branchTo = [&](uint16_t target, uint8_t mark)
+	{
+		flags[target & addressMask] |= LEADER | mark;
+		pending.push_back(static_cast<uint16_t>(target & addressMask));
+	};
+
+	while (!pending.empty())
+	{
+		uint16_t address = pending.back();
+		pending.pop_back();
+
+		// Only the ROM is decoded; anything past it would run through zero bytes
+		while (address >= START_ADDRESS && address + Length(address) <= romEnd && !visited[address])
+		{
+			unsigned int length = Length(address);
+
+			visited[address] = true;
+			for (unsigned int i = 0; i < length; ++i)
+			{
+				flags[address + i] |= CODE;
+			}
+
+			uint16_t opcode = Opcode(address);
+			uint16_t nnn = opcode & 0x0FFFu;
+			Flow flow = LookUpOpcode(opcode, quirks).flow;
+			uint16_t next = static_cast<uint16_t>(address + length);
+
+			if (flow == Flow::Jump)
+			{
+				branchTo(nnn, 0);
+				break;
+			}
+			else if (flow == Flow::Call)
+			{
+				branchTo(nnn, CALLED);
+				branchTo(next, 0);
+				break;
+			}
+			else if (flow == Flow::Skip)
+			{
+				branchTo(next, 0);
+				branchTo(static_cast<uint16_t>(next + Length(next)), 0);
+				break;
+			}
+			else if (flow == Flow::Return || flow == Flow::IndirectJump || flow == Flow::Exit)
+			{
+				break;
+			}
+
+			// Next and Invalid both carry on, as the interpreter does
+			address = next;
+		}
+	}
+}
+
+// One block per leader, running until a branch or the next leader
+void ControlFlowGraph::BuildBlocks()
+{
+	for (unsigned int leader = START_ADDRESS; leader + 1u < romEnd; ++leader)
+	{
+		if (!(flags[leader] & LEADER) || !(flags[leader] & CODE))
+		{
+			continue;
+		}
+
+		Block block;
+		block.start = static_cast<uint16_t>(leader);
+		block.callTarget = (flags[leader] & CALLED) != 0;
+
+		uint16_t address = block.start;
+
+		for (;;)
+		{
+			uint16_t opcode = Opcode(address);
+			Flow flow = LookUpOpcode(opcode, quirks).flow;
+			uint16_t nnn = opcode & 0x0FFFu;
+			uint16_t next = static_cast<uint16_t>(address + Length(address));
+
+			block.exit = flow == Flow::Invalid ? Flow::Next : flow;
+
+			if (flow == Flow::Jump)
+			{
+				block.successors = { nnn };
+				block.selfLoop = nnn == address;
+			}
+			else if (flow == Flow::Call)
+			{
+				block.successors = { nnn, next };
+			}
+			else if (flow == Flow::Skip)
+			{
+				block.successors = { next, static_cast<uint16_t>(next + Length(next)) };
+			}
+			else if (flow == Flow::Next || flow == Flow::Invalid)
+			{
+				// Straight on, unless the next instruction starts a block of its own or was never reached
+				if (next + 1u < romEnd && (flags[next] & CODE) && !(flags[next] & LEADER))
+				{
+					address = next;
+					continue;
+				}
+
+				if (next + 1u < romEnd && (flags[next] & CODE))
+				{
+					block.successors = { next };
+				}
+			}
+
+			block.end = next;
+			break;
+		}
+
+		blocks[block.start] = block;
+	}
+}
+
+// Calls are followed into the callee, and the return site is entered with what
+// the callee's returns leave in I. Each block's entry only ever narrows, from
+// unreached through exact and table to unknown, so the passes settle quickly
+void ControlFlowGraph::TraceIndex()
+{
+	// The returns of each subroutine: the blocks reached from its start without entering the subroutines it calls
+	std::map<uint16_t, std::vector<uint16_t>> returns;
+
+	for (auto const& entry : blocks)
+	{
+		if (!entry.second.callTarget)
+		{
+			continue;
+		}
+
+		std::set<uint16_t> seen{ entry.first };
+		std::vector<uint16_t> pending{ entry.first };
+
+		while (!pending.empty())
+		{
+			auto block = blocks.find(pending.back());
+			pending.pop_back();
+
+			if (block == blocks.end())
+			{
+				continue;
+			}
+
+			if (block->second.exit == Flow::Return)
+			{
+				returns[entry.first].push_back(block->first);
+			}
+
+			auto const& successors = block->second.successors;
+			for (size_t i = block->second.exit == Flow::Call ? 1 : 0; i < successors.size(); ++i)
+			{
+				if (seen.insert(successors[i]).second)
+				{
+					pending.push_back(successors[i]);
+				}
+			}
+		}
+	}
+
+	// Power-on leaves I at 0, but nothing should be read into that
+	std::map<uint16_t, IndexState> entries;
+	entries[START_ADDRESS].kind = IndexState::Kind::Unknown;
+
+	auto enter = [&](uint16_t address, IndexState const& state)
+	{
+		return blocks.count(address) != 0 && Merge(entries[address], state);
+	};
+
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+
+		for (auto const& entry : blocks)
+		{
+			IndexState in = entries[entry.first];
+
+			if (in.kind == IndexState::Kind::Unreached)
+			{
+				continue;
+			}
+
+			Block const& block = entry.second;
+			IndexState out = RunBlock(block, in, false);
+
+			if (block.exit != Flow::Call)
+			{
+				for (uint16_t successor : block.successors)
+				{
+					changed |= enter(successor, out);
+				}
+				continue;
+			}
+
+			changed |= enter(block.successors[0], out);
+
+			IndexState returned;
+			for (uint16_t address : returns[block.successors[0]])
+			{
+				if (entries[address].kind != IndexState::Kind::Unreached)
+				{
+					Merge(returned, RunBlock(blocks[address], entries[address], false));
+				}
+			}
+			changed |= enter(block.successors[1], returned);
+		}
+	}
+
+	for (auto const& entry : blocks)
+	{
+		IndexState const& in = entries[entry.first];
+
+		if (in.kind != IndexState::Kind::Unreached)
+		{
+			RunBlock(entry.second, in, true);
+		}
+	}
+}
+
+ControlFlowGraph::IndexState ControlFlowGraph::RunBlock(Block const& block, IndexState state, bool mark)
+{
+	typedef IndexState::Kind Kind;
+	QuirkFlags quirkFlags = GetQuirkFlags(quirks);
+
+	// Marks length bytes from I; a table runs on to the next code past them
+	auto markIndexed = [&](unsigned int length)
+	{
+		if (!mark || (state.kind != Kind::Exact && state.kind != Kind::Table))
+		{
+			return;
+		}
+
+		if (state.kind == Kind::Table)
+		{
+			while (state.address + length < romEnd && !(flags[state.address + length] & CODE))
+			{
+				++length;
+			}
+		}
+
+		MarkData(state.address, length);
+	};
+
+	for (uint16_t address = block.start; address != block.end; address = static_cast<uint16_t>(address + Length(address)))
+	{
+		uint16_t opcode = Opcode(address);
+		uint16_t nnn = opcode & 0x0FFFu;
+		uint8_t x = (opcode & 0x0F00u) >> 8u;
+		uint8_t y = (opcode & 0x00F0u) >> 4u;
+		uint8_t n = opcode & 0x000Fu;
+
+		switch (Chip8::DecodeOp(opcode, quirkFlags.superChip, quirkFlags.xoChip))
+		{
+			case Op::OP_Annn:
+			case Op::OP_F000:
+				state.kind = Kind::Exact;
+				state.address = opcode >= 0xF000u ? Opcode(static_cast<uint16_t>(address + 2u)) : nnn;
+				// Whatever reads it, something is there
+				if (mark)
+				{
+					MarkData(state.address, 1);
+				}
+				break;
+			case Op::OP_Dxyn:
+				// Dxy0 is a 16x16 sprite with the SUPER-CHIP instructions
+				markIndexed((n == 0 && quirkFlags.superChip ? 32u : n) * state.planes);
+				break;
+			case Op::OP_5xy2:
+			case Op::OP_5xy3:
+				markIndexed((x > y ? x - y : y - x) + 1u);
+				break;
+			case Op::OP_F002:
+				markIndexed(AUDIO_PATTERN_SIZE);
+				break;
+			case Op::OP_Fn01:
+				// Plane 0 draws nothing, but its sprites are still laid out one plane wide
+				state.planes = x == 3 ? 2u : 1u;
+				break;
+			case Op::OP_Fx33:
+				markIndexed(3);
+				break;
+			case Op::OP_Fx55:
+			case Op::OP_Fx65:
+				markIndexed(x + 1u);
+				// Some dialects leave I past the registers
+				if (quirkFlags.indexIncrement != IndexIncrement::None)
+				{
+					state.address = static_cast<uint16_t>(state.address + x + (quirkFlags.indexIncrement == IndexIncrement::XPlusOne ? 1u : 0u));
+				}
+				break;
+			case Op::OP_Fx1E:
+				if (state.kind == Kind::Exact)
+				{
+					state.kind = Kind::Table;
+				}
+				break;
+			case Op::OP_Fx29:
+				state.kind = Kind::Unknown;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return state;
+}
+
+bool ControlFlowGraph::Merge(IndexState& into, IndexState const& from)
+{
+	typedef IndexState::Kind Kind;
+
+	if (from.kind == Kind::Unreached)
+	{
+		return false;
+	}
+
+	if (into.kind == Kind::Unreached)
+	{
+		into = from;
+		return true;
+	}
+
+	IndexState merged = into;
+	merged.planes = into.planes < from.planes ? into.planes : from.planes;
+
+	if (into.kind == Kind::Unknown || from.kind == Kind::Unknown || into.address != from.address)
+	{
+		merged.kind = Kind::Unknown;
+	}
+	else if (into.kind != from.kind)
+	{
+		// The same address, reached exactly on one path and into its table on another
+		merged.kind = Kind::Table;
+	}
+
+	bool changed = merged.kind != into.kind || merged.planes != into.planes;
+	into = merged;
+	return changed;
+}
+
+void ControlFlowGraph::WriteText(std::ostream& out) const
+{
+	unsigned int codeBytes = 0, dataBytes = 0;
+	for (unsigned int address = START_ADDRESS; address < romEnd; ++address)
+	{
+		codeBytes += (flags[address] & CODE) ? 1 : 0;
+		dataBytes += (flags[address] & DATA) && !(flags[address] & CODE) ? 1 : 0;
+	}
+
+	out << "; " << romEnd - START_ADDRESS << " bytes, " << blocks.size() << " blocks, " << codeBytes << " bytes of code, " << dataBytes
+		<< " bytes of data\n";
+
+	unsigned int address = START_ADDRESS;
+
+	while (address < romEnd)
+	{
+		auto block = blocks.find(static_cast<uint16_t>(address));
+
+		if (block != blocks.end())
+		{
+			Block const& b = block->second;
+
+			out << "\n" << Hex(b.start, 3) << ":";
+			if (b.callTarget)
+			{
+				out << " ; subroutine";
+			}
+			out << "\n";
+
+			for (unsigned int pc = b.start; pc < b.end; pc += Length(static_cast<uint16_t>(pc)))
+			{
+				out << "  " << Hex(pc, 3) << "  " << Hex(Opcode(static_cast<uint16_t>(pc)), 4) << "  " << Instruction(static_cast<uint16_t>(pc)) << "\n";
+			}
+
+			out << "  ; ->";
+			for (uint16_t successor : b.successors)
+			{
+				out << " " << Hex(successor, 3);
+			}
+			if (b.selfLoop)
+			{
+				out << " (halts)";
+			}
+			else if (b.exit == Flow::Return)
+			{
+				out << " return";
+			}
+			else if (b.exit == Flow::Exit)
+			{
+				out << " exit";
+			}
+			else if (b.exit == Flow::IndirectJump)
+			{
+				out << " V0 + " << Hex(Opcode(static_cast<uint16_t>(b.end - 2u)) & 0x0FFFu, 3);
+			}
+			out << "\n";
+
+			address = b.end;
+			continue;
+		}
+
+		// A run of bytes outside any block: sprite data shown one byte per line as
+		// pixels, bytes nothing was seen touching packed several to a line
+		out << "\n";
+
+		while (address < romEnd && blocks.find(static_cast<uint16_t>(address)) == blocks.end())
+		{
+			if (flags[address] & DATA)
+			{
+				std::string pixels;
+				for (int bit = 7; bit >= 0; --bit)
+				{
+					pixels += (memory[address] >> bit) & 1 ? '#' : '.';
+				}
+
+				out << "  " << Hex(address, 3) << "  " << Hex(memory[address], 2) << "    db 0x" << Hex(memory[address], 2) << "  ; " << pixels << "\n";
+				++address;
+				continue;
+			}
+
+			out << "  " << Hex(address, 3) << "        ";
+			unsigned int count = 0;
+			while (count < UNREACHED_BYTES_PER_LINE && address < romEnd && !(flags[address] & DATA)
+				&& blocks.find(static_cast<uint16_t>(address)) == blocks.end())
+			{
+				out << (count ? ", " : "db ") << "0x" << Hex(memory[address], 2);
+				++address;
+				++count;
+			}
+			out << "  ; unreached\n";
+		}
+	}
+}
+
+void ControlFlowGraph::WriteGraphviz(std::ostream& out) const
+{
+	out << "digraph rom {\n";
+	out << "  node [shape=box, fontname=\"monospace\"];\n";
+
+	for (auto const& entry : blocks)
+	{
+		Block const& block = entry.second;
+
+		out << "  " << NodeName(block.start) << " [label=\"";
+		for (unsigned int pc = block.start; pc < block.end; pc += Length(static_cast<uint16_t>(pc)))
+		{
+			out << Hex(pc, 3) << "  " << Instruction(static_cast<uint16_t>(pc)) << "\\l";
+		}
+		out << "\"" << (block.callTarget ? ", peripheries=2" : "") << "];\n";
+	}
+
+	std::set<uint16_t> outside;
+
+	for (auto const& entry : blocks)
+	{
+		Block const& block = entry.second;
+
+		for (size_t i = 0; i < block.successors.size(); ++i)
+		{
+			uint16_t target = block.successors[i];
+
+			// Branches out of the ROM get a node of their own
+			if (blocks.find(target) == blocks.end() && outside.insert(target).second)
+			{
+				out << "  " << NodeName(target) << " [label=\"" << Hex(target, 3) << " (not decoded)\", style=dashed];\n";
+			}
+
+			out << "  " << NodeName(block.start) << " -> " << NodeName(target);
+
+			if (block.exit == Flow::Call)
+			{
+				out << (i == 0 ? " [style=dashed, label=\"call\"]" : " [label=\"return\"]");
+			}
+			else if (block.exit == Flow::Skip)
+			{
+				out << (i == 0 ? " [label=\"no skip\"]" : " [label=\"skip\"]");
+			}
+
+			out << ";\n";
+		}
+	}
+
+	out << "}\n";
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Chip8.hpp"
+
+// How an instruction passes control on
+enum class Flow
+{
+	Next,// falls through to the next instruction
+	Jump,// 1nnn
+	Call,// 2nnn, returning to pc + 2
+	Return,// 00EE
+	Skip,// 3xkk 4xkk 5xy0 9xy0 Ex9E ExA1: the next instruction or the one after it
+	IndirectJump,// Bnnn, target depends on V0
+	Exit,// 00FD, stops the interpreter
+	Invalid// no handler; the interpreter treats it as a no-op
+};
+
+// Mnemonic and flow of an opcode. Opcodes are decoded with Chip8::DecodeOp, which
+// fills the interpreter's handler tables, so every opcode means here what it does
+// when run under the profile. XO-CHIP's F000 is four bytes long; its address word
+// is not part of the opcode and ControlFlowGraph's listings print it after the mnemonic.
+struct OpcodeInfo
+{
+	char const* format;// mnemonic with x, y, n, kk and nnn fields spelled as {x} {y} {n} {kk} {nnn}
+	Flow flow;
+};
+
+OpcodeInfo const& LookUpOpcode(uint16_t opcode, QuirkProfile profile = QuirkProfile::Default);
+// Assembly text of one instruction, e.g. "LD V3, 0x12"
+std::string Disassemble(uint16_t opcode, QuirkProfile profile = QuirkProfile::Default);
+
+// Control-flow graph of a ROM, found by recursive traversal from START_ADDRESS:
+// every jump, call and skip target reached is decoded, and everything never
+// reached as code is data. I is followed along the graph from the Annn or F000
+// that load it, into subroutines and back out of them, to the Dxyn, Fx33, Fx55
+// and Fx65 that use it, which mark the bytes they read or write as data; that is
+// how sprites are told apart from code that merely sits between them. Once Fx1E
+// has added to I, it is somewhere in a table that runs up to the next code.
+class ControlFlowGraph
+{
+public:
+	struct Block
+	{
+		uint16_t start;
+		uint16_t end;// one past the last instruction
+		Flow exit;// flow of the last instruction
+		std::vector<uint16_t> successors;// for Skip, not taken then taken; for Call, the callee then the return site
+		bool callTarget{};
+		bool selfLoop{};// 1nnn to itself, how most ROMs halt
+	};
+
+	// The dialect to decode in, as Chip8::SetQuirks; takes effect at the next LoadROM
+	void SetQuirks(QuirkProfile profile) { quirks = profile; }
+
+	// Memory holds the fonts and the ROM at START_ADDRESS, as after Chip8::LoadROM
+	bool LoadROM(char const* filename);
+	void LoadROM(uint8_t const* data, size_t size);
+
+	std::map<uint16_t, Block> const& Blocks() const { return blocks; }
+	bool IsCode(uint16_t address) const { return (flags[address & addressMask] & CODE) != 0; }
+	bool IsData(uint16_t address) const { return (flags[address & addressMask] & DATA) != 0; }
+
+	// Listing of the ROM in address order: blocks with their instructions, then data as bytes
+	void WriteText(std::ostream& out) const;
+	// The graph in Graphviz dot format, one node per block
+	void WriteGraphviz(std::ostream& out) const;
+
+private:
+	static const uint8_t CODE = 1;// first or second byte of a reached instruction
+	static const uint8_t DATA = 2;// read or written through I
+	static const uint8_t LEADER = 4;// starts a block
+	static const uint8_t CALLED = 8;// target of a 2nnn
+
+	uint16_t Opcode(uint16_t address) const;
+	// 4 for XO-CHIP's F000 nnnn, 2 for everything else
+	unsigned int Length(uint16_t address) const;
+	// Disassemble, plus the address word of F000 nnnn
+	std::string Instruction(uint16_t address) const;
+	// What every path reaching an instruction agrees I holds
+	struct IndexState
+	{
+		enum class Kind : uint8_t
+		{
+			Unreached,// no path found here yet
+			Exact,// I is address
+			Table,// I is an unknown way into the table at address
+			Unknown
+		};
+
+		Kind kind{Kind::Unreached};
+		uint16_t address{};
+		unsigned int planes{1};// bitplanes Dxyn draws, each from its own sprite after the last; Fn01 sets them
+	};
+
+	void Analyze();
+	void Trace();
+	void BuildBlocks();
+	// Follows I from block to block until every block's entry state settles, then marks what it points at
+	void TraceIndex();
+	// The state block leaves I in, entered with state; with mark, also marks the bytes its instructions use through I
+	IndexState RunBlock(Block const& block, IndexState state, bool mark);
+	// Narrows into to what it and from agree on, returning whether into changed
+	static bool Merge(IndexState& into, IndexState const& from);
+	void MarkData(uint16_t address, unsigned int length);
+
+	// Sized for XO-CHIP; the other profiles only use the first 4 KB
+	uint8_t memory[XO_MEMORY_SIZE]{};
+	uint8_t flags[XO_MEMORY_SIZE]{};
+	uint16_t addressMask{MEMORY_SIZE - 1u};
+	unsigned int romEnd{START_ADDRESS};
+	QuirkProfile quirks{QuirkProfile::Default};
+	std::map<uint16_t, Block> blocks;
+};
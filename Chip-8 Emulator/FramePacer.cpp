@@ -0,0 +1,94 @@
+#include "FramePacer.hpp"
+#include <cmath>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <time.h>
+#endif
+
+FramePacer::FramePacer(double frequencyHz, std::chrono::microseconds spin)
+	: period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frequencyHz))),
+	  spin(spin),
+	  deadline(Clock::now() + period)
+{
+}
+
+void FramePacer::WaitForNextFrame()
+{
+	Clock::time_point now = Clock::now();
+
+	// Fell behind by a whole frame or more: don't try to catch up with a burst of frames
+	if (now >= deadline)
+	{
+		++missed;
+		Record(std::chrono::duration<double, std::micro>(now - deadline).count());
+		deadline = now + period;
+		return;
+	}
+
+	if (deadline - now > spin)
+	{
+		SleepUntil(deadline - spin);
+	}
+
+	while ((now = Clock::now()) < deadline)
+	{
+		std::this_thread::yield();
+	}
+
+	Record(std::chrono::duration<double, std::micro>(now - deadline).count());
+	deadline += period;
+}
+
+void FramePacer::SleepUntil(Clock::time_point wakeTime)
+{
+#if defined(__linux__)
+	// steady_clock is CLOCK_MONOTONIC here, so the deadline can be passed as an absolute time
+	auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeTime.time_since_epoch()).count();
+
+	timespec request;
+	request.tv_sec = static_cast<time_t>(sinceEpoch / 1000000000);
+	request.tv_nsec = static_cast<long>(sinceEpoch % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &request, nullptr) == EINTR)
+	{
+	}
+#else
+	std::this_thread::sleep_until(wakeTime);
+#endif
+}
+
+void FramePacer::Record(double latenessUs)
+{
+	++frames;
+
+	double delta = latenessUs - mean;
+	mean += delta / frames;
+	sumSquares += delta * (latenessUs - mean);
+
+	if (latenessUs > maxLateness)
+	{
+		maxLateness = latenessUs;
+	}
+}
+
+FramePacer::Stats FramePacer::GetStats() const
+{
+	Stats stats;
+	stats.frames = frames;
+	stats.missed = missed;
+	stats.meanLatenessUs = mean;
+	stats.stddevLatenessUs = frames > 1 ? std::sqrt(sumSquares / (frames - 1)) : 0.0;
+	stats.maxLatenessUs = maxLateness;
+
+	return stats;
+}
+
+void FramePacer::Report(std::ostream& out) const
+{
+	Stats stats = GetStats();
+
+	out << "frames " << stats.frames << ", missed " << stats.missed << ", lateness mean " << stats.meanLatenessUs << " us, stddev "
+		<< stats.stddevLatenessUs << " us, max " << stats.maxLatenessUs << " us\n";
+}
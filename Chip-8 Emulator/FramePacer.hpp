@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Paces a loop to a fixed frame rate without busy-waiting: it sleeps until just
+// before each deadline and spins only for the last stretch, where the OS sleep
+// is too coarse. Deadlines advance by exactly one period, so lateness in one
+// frame does not push back the following ones.
+class FramePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit FramePacer(double frequencyHz, std::chrono::microseconds spin = std::chrono::microseconds(500));
+
+	// Blocks until the next frame is due
+	void WaitForNextFrame();
+
+	// Wake-up lateness relative to the deadlines so far
+	struct Stats
+	{
+		uint64_t frames;
+		uint64_t missed;// deadlines that had already passed, after which the schedule restarts
+		double meanLatenessUs;
+		double stddevLatenessUs;
+		double maxLatenessUs;
+	};
+
+	Stats GetStats() const;
+	void Report(std::ostream& out) const;
+
+private:
+	void SleepUntil(Clock::time_point wakeTime);
+	void Record(double latenessUs);
+
+	Clock::duration period;
+	Clock::duration spin;
+	Clock::time_point deadline;
+
+	uint64_t frames{};
+	uint64_t missed{};
+	double mean{};
+	double sumSquares{};// running sum of squared deviations (Welford)
+	double maxLateness{};
+};
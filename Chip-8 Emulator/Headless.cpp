@@ -0,0 +1,379 @@
+#include "Audio.hpp"
+#include "Chip8.hpp"
+#include "NullPlatform.hpp"
+#include "Replay.hpp"
+#include "Trace.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Final machine state, frame hash and timing on stdout
+void PrintState(Chip8 const& chip8, char const* romFilename, uint64_t frames, double seconds)
+{
+	Scheduler const& scheduler = chip8.GetScheduler();
+
+	std::cout << "rom " << romFilename << "\n";
+	std::cout << "seed " << chip8.Seed() << "\n";
+	std::cout << "quirks " << QuirkProfileName(chip8.GetQuirks()) << "\n";
+	std::cout << "cycles " << scheduler.Cycles() << "\n";
+	std::cout << "idle_cycles " << chip8.IdleCycles() << "\n";
+	std::cout << "frames " << frames << "\n";
+	std::cout << "emulated_ms " << scheduler.Nanoseconds() / 1000000 << "\n";
+	std::cout << std::hex << std::setfill('0');
+	std::cout << "pc " << std::setw(4) << chip8.PC() << "\n";
+	std::cout << "i " << std::setw(4) << chip8.Index() << "\n";
+	std::cout << "sp " << std::setw(2) << unsigned(chip8.SP()) << "\n";
+	std::cout << "dt " << std::setw(2) << unsigned(chip8.DelayTimer()) << "\n";
+	std::cout << "st " << std::setw(2) << unsigned(chip8.SoundTimer()) << "\n";
+	std::cout << "v";
+	for (unsigned int i = 0; i < REGISTER_COUNT; ++i)
+	{
+		std::cout << " " << std::setw(2) << unsigned(chip8.Registers()[i]);
+	}
+	std::cout << "\n";
+	// Every plane in use, in turn
+	uint64_t frameHash = FRAME_HASH_SEED;
+	for (unsigned int plane = 0; plane < chip8.VideoPlanes(); ++plane)
+	{
+		frameHash = HashFrame(chip8.video[plane], chip8.VideoWords(), frameHash);
+	}
+	std::cout << "frame_hash " << std::setw(16) << frameHash << "\n";
+	std::cout << std::dec << std::setfill(' ');
+	std::cout << "wall_ms " << seconds * 1000.0 << "\n";
+	std::cout << "mips " << (seconds > 0 ? scheduler.Cycles() / seconds / 1e6 : 0.0) << "\n";
+}
+
+// Replays a recording at full speed and reports whether every frame matched it.
+// With check, a table backend machine runs the same replay in lockstep and the
+// first cycle at which the two machines differ is reported.
+int Replay(char const* romFilename, char const* replayFilename, Backend backend, bool idleSkip, bool check)
+{
+	Recording recording;
+	if (!LoadRecording(recording, replayFilename))
+	{
+		std::cerr << "Cannot read recording " << replayFilename << "\n";
+		return EXIT_FAILURE;
+	}
+
+	if (HashROM(romFilename) != recording.romHash)
+	{
+		std::cerr << "Recording " << replayFilename << " was not made with ROM " << romFilename << "\n";
+		return EXIT_FAILURE;
+	}
+
+	Chip8 chip8(backend);
+	chip8.SetIdleSkip(idleSkip);
+	chip8.LoadROM(romFilename);
+	Replayer replayer(recording);
+	replayer.Start(chip8);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (check)
+	{
+		Chip8 reference(Backend::Table);
+		reference.LoadROM(romFilename);
+		Replayer referenceReplayer(recording);
+		referenceReplayer.Start(reference);
+
+		MachineState state, referenceState;
+		std::string difference;
+
+		while (!replayer.Finished(chip8) && difference.empty())
+		{
+			uint64_t next = chip8.GetScheduler().Cycles() + 1;
+			replayer.Run(chip8, next);
+			referenceReplayer.Run(reference, next);
+
+			chip8.Save(state);
+			reference.Save(referenceState);
+			if (MachineStateSize(state) != MachineStateSize(referenceState) || memcmp(&state, &referenceState, MachineStateSize(state)) != 0)
+			{
+				difference = DescribeDifference(state, referenceState);
+			}
+		}
+
+		if (!difference.empty())
+		{
+			std::cout << "check_diverged_cycle " << chip8.GetScheduler().Cycles() << "\n";
+			std::cout << "check_difference " << difference << "\n";
+		}
+		else
+		{
+			std::cout << "check_match 1\n";
+		}
+	}
+
+	// The rest of the recording, or all of it without the check
+	replayer.Run(chip8, recording.endCycle);
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	PrintState(chip8, romFilename, replayer.FramesChecked(), std::chrono::duration<double>(end - start).count());
+
+	if (replayer.Diverged())
+	{
+		std::cout << "replay_diverged_frame " << replayer.FirstMismatchFrame() << "\n";
+		std::cout << "replay_diverged_cycles " << replayer.FirstMismatchStart() << "-" << replayer.FirstMismatchEnd() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "replay_match 1\n";
+	return EXIT_SUCCESS;
+}
+
+// Runs a ROM with no window and no pacing, then prints the final machine state,
+// the frame hash and the timing on stdout
+int main(int argc, char** argv)
+{
+	char const* romFilename = nullptr;
+	char const* scriptFilename = nullptr;
+	char const* replayFilename = nullptr;
+	char const* traceFilename = nullptr;
+	char const* wavFilename = nullptr;
+	uint64_t cycleLimit = 0;
+	uint64_t frameLimit = 0;
+	uint32_t clockHz = DEFAULT_CLOCK_HZ;
+	Backend backend = Backend::Table;
+	RandomSource randomSource = RandomSource::Pcg;
+	bool randomChosen = false;
+	QuirkProfile quirks = QuirkProfile::Default;
+	bool quirksChosen = false;
+	bool seeded = false;
+	uint64_t seed = 0;
+	bool printHashes = false;
+	bool idleSkip = true;
+	bool check = false;
+	bool usage = false;
+
+	for (int i = 1; i < argc && !usage; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--cycles" && hasValue)
+		{
+			cycleLimit = std::stoull(argv[++i]);
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			frameLimit = std::stoull(argv[++i]);
+		}
+		else if (arg == "--clock" && hasValue)
+		{
+			clockHz = std::stoul(argv[++i]);
+		}
+		else if (arg == "--input" && hasValue)
+		{
+			scriptFilename = argv[++i];
+		}
+		else if (arg == "--backend" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "table")
+			{
+				backend = Backend::Table;
+			}
+			else if (name == "switch")
+			{
+				backend = Backend::Switch;
+			}
+			else if (name == "jit")
+			{
+				backend = Backend::Jit;
+			}
+			else
+			{
+				usage = true;
+			}
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			seed = std::stoull(argv[++i]);
+			seeded = true;
+		}
+		else if (arg == "--rng" && hasValue)
+		{
+			usage = !ParseRandomSource(argv[++i], randomSource);
+			randomChosen = true;
+		}
+		else if (arg == "--quirks" && hasValue)
+		{
+			usage = !ParseQuirkProfile(argv[++i], quirks);
+			quirksChosen = true;
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			traceFilename = argv[++i];
+		}
+		else if (arg == "--wav" && hasValue)
+		{
+			wavFilename = argv[++i];
+		}
+		else if (arg == "--hashes")
+		{
+			printHashes = true;
+		}
+		else if (arg == "--no-idle-skip")
+		{
+			idleSkip = false;
+		}
+		else if (arg == "--replay" && hasValue)
+		{
+			replayFilename = argv[++i];
+		}
+		else if (arg == "--check")
+		{
+			check = true;
+		}
+		else if (!romFilename && arg[0] != '-')
+		{
+			romFilename = argv[i];
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	// Exactly one of the two limits, or a recording that brings its own length, clock, seed, quirks and input
+	bool limits = (cycleLimit == 0) != (frameLimit == 0);
+	bool replay = replayFilename && cycleLimit == 0 && frameLimit == 0 && !scriptFilename && !seeded && !randomChosen && !quirksChosen
+		&& !traceFilename && !wavFilename;
+
+	if (usage || !romFilename || (replayFilename ? !replay : !limits) || (check && !replay))
+	{
+		std::cerr << "Usage: " << argv[0] << " <ROM> (--cycles <N> | --frames <N>) [--clock <Hz>] [--input <Script>]"
+			<< " [--backend table|switch|jit] [--seed <N>] [--rng pcg|xorshift|minstd]"
+			<< " [--quirks default|vip|chip48|schip|xochip] [--hashes] [--trace <File>] [--wav <File>] [--no-idle-skip]\n"
+			<< "       " << argv[0] << " <ROM> --replay <Recording> [--backend table|switch|jit] [--check] [--no-idle-skip]\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	if (replay)
+	{
+		return Replay(romFilename, replayFilename, backend, idleSkip, check);
+	}
+
+	NullPlatform platform;
+	if (scriptFilename && !platform.LoadScript(scriptFilename))
+	{
+		std::cerr << "Cannot read input script " << scriptFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	Chip8 chip8(backend);
+	chip8.SetIdleSkip(idleSkip);
+	chip8.SetQuirks(quirks);
+	if (!chip8.LoadROM(romFilename))
+	{
+		std::cerr << "Cannot read ROM " << romFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+	chip8.SetClockHz(clockHz);
+	// Without --seed the machine keeps its clock seed, so only the generator changes
+	chip8.SetRandom(randomSource, seeded ? seed : chip8.Seed());
+
+	// Every instruction into a binary trace, for TraceDump
+	std::unique_ptr<TraceWriter> trace;
+	if (traceFilename)
+	{
+		trace.reset(new TraceWriter());
+		if (!trace->Open(traceFilename, clockHz))
+		{
+			std::cerr << "Cannot write trace " << traceFilename << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		chip8.SetTrace(trace.get());
+	}
+
+	// What the machine played, rendered into a WAV file in step with emulated time
+	SoundEventRing soundRing;
+	SoundFeed soundFeed(soundRing);
+	SoundSynth synth(soundRing, AUDIO_SAMPLE_RATE);
+	WavWriter wav;
+	if (wavFilename)
+	{
+		if (!wav.Open(wavFilename, AUDIO_SAMPLE_RATE))
+		{
+			std::cerr << "Cannot write WAV file " << wavFilename << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		platform.SetSoundFeed(&soundFeed);
+		soundFeed.Update(chip8);
+	}
+
+	Scheduler const& scheduler = chip8.GetScheduler();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	while ((frameLimit == 0 || platform.Frame() < frameLimit) && (cycleLimit == 0 || scheduler.Cycles() < cycleLimit))
+	{
+		uint64_t presented = platform.FramesPresented();
+
+		platform.RunFrame(chip8, cycleLimit);
+
+		if (wavFilename)
+		{
+			// Every sample up to the emulated time reached, a device buffer at a time
+			uint64_t due = scheduler.Cycles() * AUDIO_SAMPLE_RATE / scheduler.ClockHz();
+			int16_t samples[AUDIO_BUFFER_SAMPLES];
+
+			while (wav.Samples() < due)
+			{
+				unsigned int count = static_cast<unsigned int>(std::min<uint64_t>(due - wav.Samples(), AUDIO_BUFFER_SAMPLES));
+				synth.Render(samples, count);
+				wav.Write(samples, count);
+			}
+		}
+
+		if (printHashes && platform.FramesPresented() != presented)
+		{
+			std::cout << "frame " << platform.Frame() << " hash " << std::hex << std::setw(16) << std::setfill('0') << platform.LastFrameHash()
+				<< std::dec << std::setfill(' ') << "\n";
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	PrintState(chip8, romFilename, platform.Frame(), seconds);
+
+	if (wavFilename)
+	{
+		std::cout << "wav_samples " << wav.Samples() << "\n";
+
+		if (!wav.Close())
+		{
+			std::cerr << "Cannot write WAV file " << wavFilename << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (trace)
+	{
+		chip8.SetTrace(nullptr);
+		bool written = trace->Close();
+
+		std::cout << "trace_records " << trace->Records() << "\n";
+		std::cout << "trace_stalls " << trace->Stalls() << "\n";
+
+		if (!written)
+		{
+			std::cerr << "Cannot write trace " << traceFilename << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+#if defined(CHIP8_PROFILE)
+	chip8.GetProfiler().Report(std::cout);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,711 @@
+#include "Jit.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64 1
+#endif
+
+#if defined(CHIP8_JIT_X64) && defined(_WIN32)
+#include <windows.h>
+#elif defined(CHIP8_JIT_X64)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	typedef Chip8::Op Op;
+
+	// The arena is only ever writable or executable, never both
+	uint8_t* AllocateArena(size_t size)
+	{
+#if defined(CHIP8_JIT_X64) && defined(_WIN32)
+		return static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#elif defined(CHIP8_JIT_X64)
+		void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return memory == MAP_FAILED ? nullptr : static_cast<uint8_t*>(memory);
+#else
+		(void)size;
+		return nullptr;
+#endif
+	}
+
+	void FreeArena(uint8_t* arena, size_t size)
+	{
+#if defined(CHIP8_JIT_X64) && defined(_WIN32)
+		(void)size;
+		VirtualFree(arena, 0, MEM_RELEASE);
+#elif defined(CHIP8_JIT_X64)
+		munmap(arena, size);
+#else
+		(void)arena;
+		(void)size;
+#endif
+	}
+
+	void ProtectArena(uint8_t* arena, size_t size, bool executable)
+	{
+#if defined(CHIP8_JIT_X64) && defined(_WIN32)
+		DWORD previous;
+		VirtualProtect(arena, size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous);
+#elif defined(CHIP8_JIT_X64)
+		mprotect(arena, size, executable ? (PROT_READ | PROT_EXEC) : (PROT_READ | PROT_WRITE));
+#else
+		(void)arena;
+		(void)size;
+		(void)executable;
+#endif
+	}
+}
+
+Jit::Jit(Chip8& chip8)
+	: chip8(chip8)
+{
+	context.registers = chip8.registers;
+	context.index = &chip8.index;
+	context.stack = chip8.stack;
+	context.sp = &chip8.sp;
+	context.entries = entries;
+
+	if (Supported())
+	{
+		arena = AllocateArena(ARENA_SIZE);
+	}
+
+	if (arena)
+	{
+		EmitStubs();
+		Flush();
+	}
+}
+
+Jit::~Jit()
+{
+	if (arena)
+	{
+		FreeArena(arena, ARENA_SIZE);
+	}
+}
+
+bool Jit::Supported()
+{
+#if defined(CHIP8_JIT_X64)
+	return true;
+#else
+	return false;
+#endif
+}
+
+unsigned int Jit::Run(unsigned int n)
+{
+	unsigned int executed = 0;
+
+	while (executed < n)
+	{
+		// Past the end of memory the interpreter wraps the fetch but not pc
+		Block* block = nullptr;
+
+		if (chip8.pc <= chip8.addressMask)
+		{
+			block = &blocks[chip8.pc];
+
+			if (!block->compiled)
+			{
+				Compile(chip8.pc);
+			}
+		}
+
+		// Chip8::RunCycles() interprets what has no native code, saving a call into
+		// it per instruction on ROMs that spin on one, such as a key wait
+		if (!block || !block->code)
+		{
+			break;
+		}
+
+		// A block longer than the remaining budget: interpret what is left of the
+		// budget instead, rather than compiling a new, overlapping block at every
+		// address the interpreter stops at
+		if (block->count > n - executed)
+		{
+			while (executed < n && !chip8.events)
+			{
+				chip8.Cycle();
+				++executed;
+			}
+
+			break;
+		}
+
+		uint32_t stop = verify ? RunVerified(*block) : RunNative(*block, n - executed);
+		executed += context.cycles;
+
+		// The instruction native code stopped at, the only kind that can raise an event
+		if ((stop & INTERPRET) && executed < n)
+		{
+			chip8.Cycle();
+			++executed;
+
+			if (chip8.events)
+			{
+				break;
+			}
+		}
+	}
+
+	return executed;
+}
+
+uint32_t Jit::RunNative(Block const& block, unsigned int limit)
+{
+	context.cycles = 0;
+	context.limit = limit;
+	context.tick = chip8.scheduler.CyclesUntilTick();
+	context.delayTimer = chip8.delayTimer;
+	context.idleLoops = chip8.idleSkip && !chip8.trace;
+
+	uint32_t stop = enter(&context, block.code);
+	chip8.pc = static_cast<uint16_t>(stop);
+
+	// Native code never reads the timers past the next tick, so every cycle it
+	// ran can be accounted for at once
+	chip8.AdvanceTimers(context.cycles);
+
+	return stop;
+}
+
+// Runs the one block, its entry check stopping it at the next, then replays the
+// same cycles on the interpreter and compares the two
+uint32_t Jit::RunVerified(Block const& block)
+{
+	uint8_t registers[REGISTER_COUNT];
+	memcpy(registers, chip8.registers, sizeof(registers));
+	uint16_t stack[STACK_LEVELS];
+	memcpy(stack, chip8.stack, sizeof(stack));
+	uint16_t index = chip8.index;
+	uint16_t pc = chip8.pc;
+	uint8_t sp = chip8.sp;
+	uint8_t delayTimer = chip8.delayTimer;
+	uint8_t soundTimer = chip8.soundTimer;
+	Scheduler scheduler = chip8.scheduler;
+
+	uint32_t stop = RunNative(block, block.count);
+
+	uint8_t jitRegisters[REGISTER_COUNT];
+	memcpy(jitRegisters, chip8.registers, sizeof(jitRegisters));
+	uint16_t jitStack[STACK_LEVELS];
+	memcpy(jitStack, chip8.stack, sizeof(jitStack));
+	uint16_t jitIndex = chip8.index;
+	uint16_t jitPc = chip8.pc;
+	uint8_t jitSp = chip8.sp;
+	uint8_t jitDelayTimer = chip8.delayTimer;
+	uint8_t jitSoundTimer = chip8.soundTimer;
+	uint64_t jitClock = chip8.scheduler.Cycles();
+
+	// Replay the cycles on the interpreter from the same starting state, which
+	// is then kept as the authoritative result
+	memcpy(chip8.registers, registers, sizeof(registers));
+	memcpy(chip8.stack, stack, sizeof(stack));
+	chip8.index = index;
+	chip8.pc = pc;
+	chip8.sp = sp;
+	chip8.delayTimer = delayTimer;
+	chip8.soundTimer = soundTimer;
+	chip8.scheduler = scheduler;
+
+	for (unsigned int i = 0; i < context.cycles; ++i)
+	{
+		chip8.Cycle();
+	}
+
+	if (memcmp(jitRegisters, chip8.registers, sizeof(jitRegisters)) != 0 || memcmp(jitStack, chip8.stack, sizeof(jitStack)) != 0
+		|| jitIndex != chip8.index || jitPc != chip8.pc || jitSp != chip8.sp
+		|| jitDelayTimer != chip8.delayTimer || jitSoundTimer != chip8.soundTimer || jitClock != chip8.scheduler.Cycles())
+	{
+		++mismatches;
+		std::cerr << "JIT mismatch in block at 0x" << std::hex << pc << std::dec << " (" << context.cycles << " instructions)\n";
+	}
+
+	return stop;
+}
+
+void Jit::Flush()
+{
+	for (Block& block : blocks)
+	{
+		block = Block{};
+	}
+
+	for (std::vector<uint16_t>& page : pages)
+	{
+		page.clear();
+	}
+
+	for (uint8_t const*& entry : entries)
+	{
+		entry = exitStub;
+	}
+
+	arenaUsed = stubsSize;
+}
+
+void Jit::Invalidate(uint16_t address, unsigned int length)
+{
+	const unsigned int memorySize = chip8.MemorySize();
+	const unsigned int pageCount = memorySize / PAGE_SIZE;
+
+	if (length >= memorySize)
+	{
+		address = 0;
+		length = memorySize;
+	}
+
+	unsigned int first = (address & chip8.addressMask) / PAGE_SIZE;
+	unsigned int last = ((address + (length > 0 ? length - 1u : 0u)) & chip8.addressMask) / PAGE_SIZE;
+
+	// Walk the pages from first to last, wrapping at the end of memory. Only the
+	// blocks compiled from the bytes written go, as ROMs keep their variables
+	// next to their code
+	for (unsigned int page = first;; page = (page + 1u) % pageCount)
+	{
+		std::vector<uint16_t>& starts = pages[page];
+
+		for (size_t i = 0; i < starts.size();)
+		{
+			uint16_t start = starts[i];
+			bool overlaps = ((start - address) & chip8.addressMask) < length || ((address - start) & chip8.addressMask) < blocks[start].size;
+
+			if (overlaps || !blocks[start].compiled)
+			{
+				blocks[start].compiled = false;
+				entries[start] = exitStub;
+				starts[i] = starts.back();
+				starts.pop_back();
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		if (page == last)
+		{
+			break;
+		}
+	}
+}
+
+// The entry trampoline loads the registers native code keeps and jumps to the
+// block; blocks leave through the exit stub with the pc to carry on from in eax
+void Jit::EmitStubs()
+{
+	ProtectArena(arena, ARENA_SIZE, false);
+
+	enter = reinterpret_cast<EnterFunc>(arena + arenaUsed);
+#if defined(_WIN32)
+	Bytes({ 0x49, 0x89, 0xCA });// mov r10, rcx
+#else
+	Bytes({ 0x49, 0x89, 0xFA });// mov r10, rdi
+#endif
+	Bytes({ 0x4D, 0x8B, 0x42, uint8_t(offsetof(Context, registers)) });// mov r8, [r10+registers]
+	Bytes({ 0x4D, 0x8B, 0x4A, uint8_t(offsetof(Context, index)) });// mov r9, [r10+index]
+	Bytes({ 0x45, 0x8B, 0x5A, uint8_t(offsetof(Context, cycles)) });// mov r11d, [r10+cycles]
+#if defined(_WIN32)
+	Bytes({ 0xFF, 0xE2 });// jmp rdx
+#else
+	Bytes({ 0xFF, 0xE6 });// jmp rsi
+#endif
+
+	exitStub = arena + arenaUsed;
+	Bytes({ 0x45, 0x89, 0x5A, uint8_t(offsetof(Context, cycles)) });// mov [r10+cycles], r11d
+	Byte(0xC3);// ret
+
+	stubsSize = arenaUsed;
+
+	ProtectArena(arena, ARENA_SIZE, true);
+}
+
+Jit::Kind Jit::Classify(uint16_t address) const
+{
+	uint16_t opcode = (chip8.memory[address] << 8u) | chip8.memory[address + 1u];
+	QuirkFlags quirks = GetQuirkFlags(chip8.quirks);
+
+	switch (Chip8::DecodeOp(opcode, quirks.superChip, quirks.xoChip))
+	{
+		case Op::OP_6xkk:
+		case Op::OP_7xkk:
+		case Op::OP_8xy0:
+		case Op::OP_8xy1:
+		case Op::OP_8xy2:
+		case Op::OP_8xy3:
+		case Op::OP_8xy4:
+		case Op::OP_8xy5:
+		case Op::OP_8xy6:
+		case Op::OP_8xy7:
+		case Op::OP_8xyE:
+		case Op::OP_Annn:
+		case Op::OP_Fx07:
+		case Op::OP_Fx1E:
+		case Op::OP_Fx29:
+			return Kind::Straight;
+
+		case Op::OP_1nnn:
+		case Op::OP_2nnn:
+		case Op::OP_00EE:
+			return Kind::Branch;
+
+		case Op::OP_3xkk:
+		case Op::OP_4xkk:
+		case Op::OP_5xy0:
+		case Op::OP_9xy0:
+		{
+			// Both ways on, past the instruction skipped, have to be inside memory
+			unsigned int next = address + 2u;
+
+			if (next + 1u >= chip8.MemorySize())
+			{
+				return Kind::Interpreted;
+			}
+
+			unsigned int skip = quirks.xoChip ? chip8.SkipLength<XoChipQuirks>(next) : 2u;
+			return next + skip < chip8.MemorySize() ? Kind::Branch : Kind::Interpreted;
+		}
+
+		default:
+			return Kind::Interpreted;
+	}
+}
+
+void Jit::Compile(uint16_t start)
+{
+	// Worst case is MAX_INSTRUCTION_BYTES per instruction plus the block's entry and exit
+	const size_t worstCase = MAX_BLOCK_LENGTH * MAX_INSTRUCTION_BYTES + BLOCK_OVERHEAD_BYTES;
+
+	if (arena && ARENA_SIZE - arenaUsed < worstCase)
+	{
+		Flush();
+	}
+
+	Block& block = blocks[start];
+	block = Block{};
+
+	// Measure the block first, as its entry checks the whole of it against the batch
+	unsigned int address = start;
+	Kind last = Kind::Interpreted;
+
+	while (block.count < MAX_BLOCK_LENGTH && address + 1u < chip8.MemorySize())
+	{
+		last = Classify(static_cast<uint16_t>(address));
+
+		if (last == Kind::Interpreted)
+		{
+			break;
+		}
+
+		++block.count;
+		address += 2;
+
+		if (last == Kind::Branch)
+		{
+			break;
+		}
+	}
+
+	if (arena && block.count > 0)
+	{
+		ProtectArena(arena, ARENA_SIZE, false);
+
+		block.code = arena + arenaUsed;
+
+		// Count the block's cycles on entry, or stop before it when the batch can't run all of them
+		Bytes({ 0x41, 0x8D, 0x43, uint8_t(block.count) });// lea eax, [r11+count]
+		Bytes({ 0x41, 0x3B, 0x42, uint8_t(offsetof(Context, limit)) });// cmp eax, [r10+limit]
+		Bytes({ 0x76, 0x0A });// jbe body
+		EmitExit(start, 0);
+		Bytes({ 0x41, 0x89, 0xC3 });// body: mov r11d, eax
+
+		for (unsigned int i = 0; i < block.count; ++i)
+		{
+			Emit(static_cast<uint16_t>(start + 2u * i), i, block.count);
+		}
+
+		if (last == Kind::Interpreted)
+		{
+			EmitExit(address | INTERPRET, 0);
+		}
+		else if (last == Kind::Straight)
+		{
+			// Cut off at MAX_BLOCK_LENGTH or the end of memory
+			if (address < chip8.MemorySize())
+			{
+				EmitDispatch(static_cast<uint16_t>(address));
+			}
+			else
+			{
+				EmitExit(address, 0);
+			}
+		}
+
+		ProtectArena(arena, ARENA_SIZE, true);
+	}
+
+	block.compiled = true;
+	entries[start] = block.code ? block.code : exitStub;
+
+	// The block depends on its instructions and on the one after them, which
+	// either decided where it ended or is what a skip steps over
+	unsigned int end = address + 2u < chip8.MemorySize() ? address + 2u : chip8.MemorySize();
+	block.size = static_cast<uint16_t>(end - start);
+
+	for (unsigned int page = start / PAGE_SIZE; page * PAGE_SIZE < end; ++page)
+	{
+		// A recompiled block can still be listed on a page the write that dropped it missed
+		if (std::find(pages[page].begin(), pages[page].end(), start) == pages[page].end())
+		{
+			pages[page].push_back(start);
+		}
+	}
+}
+
+// Emits the native code for one instruction Classify accepted
+void Jit::Emit(uint16_t address, unsigned int position, unsigned int count)
+{
+	uint16_t opcode = (chip8.memory[address] << 8u) | chip8.memory[address + 1u];
+	uint8_t x = (opcode & 0x0F00u) >> 8u;
+	uint8_t y = (opcode & 0x00F0u) >> 4u;
+	uint8_t kk = opcode & 0x00FFu;
+	uint16_t nnn = opcode & 0x0FFFu;
+	uint16_t next = static_cast<uint16_t>(address + 2u);
+	// Quirks are constants as far as the emitted code goes; SetQuirks flushes every block
+	QuirkFlags quirks = GetQuirkFlags(chip8.quirks);
+
+	// Every sequence below touches the registers in the same order as the
+	// matching OP_* handler, so aliasing with VF behaves identically
+	switch (Chip8::DecodeOp(opcode, quirks.superChip, quirks.xoChip))
+	{
+		case Op::OP_6xkk:
+			Bytes({ 0x41, 0xC6, 0x40, x, kk });// mov byte [r8+x], kk
+			break;
+
+		case Op::OP_7xkk:
+			Bytes({ 0x41, 0x80, 0x40, x, kk });// add byte [r8+x], kk
+			break;
+
+		case Op::OP_8xy0:
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, y });// movzx eax, byte [r8+y]
+			Bytes({ 0x41, 0x88, 0x40, x });// mov [r8+x], al
+			break;
+
+		case Op::OP_8xy1:
+		case Op::OP_8xy2:
+		case Op::OP_8xy3:
+		{
+			static const uint8_t operation[] = { 0x00, 0x08, 0x20, 0x30 };// or, and, xor
+			Bytes({ 0x41, 0x0F, 0xB6, 0x48, y });// movzx ecx, byte [r8+y]
+			Bytes({ 0x41, operation[opcode & 0x000Fu], 0x48, x });// op [r8+x], cl
+			if (quirks.resetVf)
+			{
+				Bytes({ 0x41, 0xC6, 0x40, 0x0F, 0x00 });// mov byte [r8+15], 0
+			}
+			break;
+		}
+
+		case Op::OP_8xy4:
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, x });// movzx eax, byte [r8+x]
+			Bytes({ 0x41, 0x0F, 0xB6, 0x48, y });// movzx ecx, byte [r8+y]
+			Bytes({ 0x01, 0xC8 });// add eax, ecx
+			Bytes({ 0x3D, 0xFF, 0x00, 0x00, 0x00 });// cmp eax, 255
+			Bytes({ 0x0F, 0x97, 0xC2 });// seta dl
+			Bytes({ 0x41, 0x88, 0x50, 0x0F });// mov [r8+15], dl
+			Bytes({ 0x41, 0x88, 0x40, x });// mov [r8+x], al
+			break;
+
+		case Op::OP_8xy5:
+		case Op::OP_8xy7:
+		{
+			// 8xy5 is Vx - Vy and 8xy7 is Vy - Vx
+			uint8_t left = (opcode & 0x000Fu) == 0x5 ? x : y;
+			uint8_t right = (opcode & 0x000Fu) == 0x5 ? y : x;
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, left });// movzx eax, byte [r8+left]
+			Bytes({ 0x41, 0x0F, 0xB6, 0x48, right });// movzx ecx, byte [r8+right]
+			Bytes({ 0x39, 0xC8 });// cmp eax, ecx
+			Bytes({ 0x0F, 0x97, 0xC2 });// seta dl
+			Bytes({ 0x41, 0x88, 0x50, 0x0F });// mov [r8+15], dl
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, left });// movzx eax, byte [r8+left]
+			Bytes({ 0x41, 0x0F, 0xB6, 0x48, right });// movzx ecx, byte [r8+right]
+			Bytes({ 0x29, 0xC8 });// sub eax, ecx
+			Bytes({ 0x41, 0x88, 0x40, x });// mov [r8+x], al
+			break;
+		}
+
+		case Op::OP_8xy6:
+			if (quirks.shiftVy)
+			{
+				Bytes({ 0x41, 0x0F, 0xB6, 0x40, y });// movzx eax, byte [r8+y]
+				Bytes({ 0x83, 0xE0, 0x01 });// and eax, 1
+				Bytes({ 0x41, 0x88, 0x40, 0x0F });// mov [r8+15], al
+				Bytes({ 0x41, 0x0F, 0xB6, 0x40, y });// movzx eax, byte [r8+y]
+				Bytes({ 0xD1, 0xE8 });// shr eax, 1
+				Bytes({ 0x41, 0x88, 0x40, x });// mov [r8+x], al
+				break;
+			}
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, x });// movzx eax, byte [r8+x]
+			Bytes({ 0x83, 0xE0, 0x01 });// and eax, 1
+			Bytes({ 0x41, 0x88, 0x40, 0x0F });// mov [r8+15], al
+			Bytes({ 0x41, 0xD0, 0x68, x });// shr byte [r8+x], 1
+			break;
+
+		case Op::OP_8xyE:
+			if (quirks.shiftVy)
+			{
+				Bytes({ 0x41, 0x0F, 0xB6, 0x40, y });// movzx eax, byte [r8+y]
+				Bytes({ 0xC1, 0xE8, 0x07 });// shr eax, 7
+				Bytes({ 0x41, 0x88, 0x40, 0x0F });// mov [r8+15], al
+				Bytes({ 0x41, 0x0F, 0xB6, 0x40, y });// movzx eax, byte [r8+y]
+				Bytes({ 0xD1, 0xE0 });// shl eax, 1
+				Bytes({ 0x41, 0x88, 0x40, x });// mov [r8+x], al
+				break;
+			}
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, x });// movzx eax, byte [r8+x]
+			Bytes({ 0xC1, 0xE8, 0x07 });// shr eax, 7
+			Bytes({ 0x41, 0x88, 0x40, 0x0F });// mov [r8+15], al
+			Bytes({ 0x41, 0xD0, 0x60, x });// shl byte [r8+x], 1
+			break;
+
+		case Op::OP_Annn:
+			Bytes({ 0x66, 0x41, 0xC7, 0x01, uint8_t(nnn & 0xFFu), uint8_t(nnn >> 8u) });// mov word [r9], nnn
+			break;
+
+		case Op::OP_Fx07:
+			// The timer only holds still until the next tick; from there on Fx07 is interpreted
+			Bytes({ 0x41, 0x8D, 0x43, uint8_t(position - count) });// lea eax, [r11+position-count], the cycles before this one
+			Bytes({ 0x41, 0x3B, 0x42, uint8_t(offsetof(Context, tick)) });// cmp eax, [r10+tick]
+			Bytes({ 0x72, 0x0D });// jb read
+			Bytes({ 0x41, 0x89, 0xC3 });// mov r11d, eax
+			EmitExit(address | INTERPRET, 0);
+			Bytes({ 0x41, 0x0F, 0xB6, 0x42, uint8_t(offsetof(Context, delayTimer)) });// read: movzx eax, byte [r10+delayTimer]
+			Bytes({ 0x41, 0x88, 0x40, x });// mov [r8+x], al
+			break;
+
+		case Op::OP_Fx1E:
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, x });// movzx eax, byte [r8+x]
+			Bytes({ 0x66, 0x41, 0x01, 0x01 });// add word [r9], ax
+			break;
+
+		case Op::OP_Fx29:
+			Bytes({ 0x41, 0x0F, 0xB6, 0x40, x });// movzx eax, byte [r8+x]
+			Bytes({ 0x8D, 0x44, 0x80, uint8_t(FONTSET_START_ADDRESS) });// lea eax, [rax+rax*4+0x50]
+			Bytes({ 0x66, 0x41, 0x89, 0x01 });// mov word [r9], ax
+			break;
+
+		case Op::OP_1nnn:
+			if (nnn == address || nnn + 4u == address)
+			{
+				// Whether this closes an idle loop depends on the delay timer when it runs, so
+				// with idle skipping on, OP_1nnn has to see it
+				Bytes({ 0x41, 0x80, 0x7A, uint8_t(offsetof(Context, idleLoops)), 0x00 });// cmp byte [r10+idleLoops], 0
+				Bytes({ 0x74, 0x0E });// je jump
+				EmitExit(address | INTERPRET, count - position);
+			}
+			EmitDispatch(nnn);
+			break;
+
+		case Op::OP_2nnn:
+			Bytes({ 0x49, 0x8B, 0x52, uint8_t(offsetof(Context, sp)) });// mov rdx, [r10+sp]
+			Bytes({ 0x0F, 0xB6, 0x0A });// movzx ecx, byte [rdx]
+			Bytes({ 0x49, 0x8B, 0x42, uint8_t(offsetof(Context, stack)) });// mov rax, [r10+stack]
+			Bytes({ 0x66, 0xC7, 0x04, 0x48, uint8_t(next & 0xFFu), uint8_t(next >> 8u) });// mov word [rax+rcx*2], next
+			Bytes({ 0xFF, 0xC1 });// inc ecx
+			Bytes({ 0x83, 0xE1, uint8_t(STACK_LEVELS - 1u) });// and ecx, STACK_LEVELS - 1
+			Bytes({ 0x88, 0x0A });// mov [rdx], cl
+			EmitDispatch(nnn);
+			break;
+
+		case Op::OP_00EE:
+			Bytes({ 0x49, 0x8B, 0x52, uint8_t(offsetof(Context, sp)) });// mov rdx, [r10+sp]
+			Bytes({ 0x0F, 0xB6, 0x0A });// movzx ecx, byte [rdx]
+			Bytes({ 0xFF, 0xC9 });// dec ecx
+			Bytes({ 0x83, 0xE1, uint8_t(STACK_LEVELS - 1u) });// and ecx, STACK_LEVELS - 1
+			Bytes({ 0x88, 0x0A });// mov [rdx], cl
+			Bytes({ 0x49, 0x8B, 0x42, uint8_t(offsetof(Context, stack)) });// mov rax, [r10+stack]
+			Bytes({ 0x0F, 0xB7, 0x04, 0x48 });// movzx eax, word [rax+rcx*2]
+			// A return address past the end of memory is left to the interpreter
+			Byte(0x3D);// cmp eax, addressMask
+			Bytes({ uint8_t(chip8.addressMask & 0xFFu), uint8_t(chip8.addressMask >> 8u), 0x00, 0x00 });
+			Bytes({ 0x0F, 0x87 });// ja exit
+			Rel32(exitStub);
+			Bytes({ 0x49, 0x8B, 0x52, uint8_t(offsetof(Context, entries)) });// mov rdx, [r10+entries]
+			Bytes({ 0xFF, 0x24, 0xC2 });// jmp [rdx+rax*8]
+			break;
+
+		case Op::OP_3xkk:
+		case Op::OP_4xkk:
+		case Op::OP_5xy0:
+		case Op::OP_9xy0:
+		{
+			bool equal = (opcode & 0xF000u) == 0x3000u || (opcode & 0xF000u) == 0x5000u;
+			unsigned int skip = quirks.xoChip ? chip8.SkipLength<XoChipQuirks>(next) : 2u;
+
+			if ((opcode & 0xF000u) == 0x3000u || (opcode & 0xF000u) == 0x4000u)
+			{
+				Bytes({ 0x41, 0x80, 0x78, x, kk });// cmp byte [r8+x], kk
+			}
+			else
+			{
+				Bytes({ 0x41, 0x0F, 0xB6, 0x40, x });// movzx eax, byte [r8+x]
+				Bytes({ 0x41, 0x3A, 0x40, y });// cmp al, [r8+y]
+			}
+
+			Bytes({ uint8_t(equal ? 0x74 : 0x75), 0x0C });// je or jne skip
+			EmitDispatch(next);
+			EmitDispatch(static_cast<uint16_t>(next + skip));// skip:
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+void Jit::EmitExit(uint32_t pc, unsigned int notRun)
+{
+	if (notRun > 0)
+	{
+		Bytes({ 0x41, 0x83, 0xEB, uint8_t(notRun) });// sub r11d, notRun
+	}
+
+	Byte(0xB8);// mov eax, pc
+	Bytes({ uint8_t(pc), uint8_t(pc >> 8u), uint8_t(pc >> 16u), uint8_t(pc >> 24u) });
+	Byte(0xE9);// jmp exit
+	Rel32(exitStub);
+}
+
+// Through the entry table, so a block that is invalidated or not compiled yet
+// sends control back to Run, which compiles it
+void Jit::EmitDispatch(uint16_t target)
+{
+	Byte(0xB8);// mov eax, target
+	Bytes({ uint8_t(target & 0xFFu), uint8_t(target >> 8u), 0x00, 0x00 });
+	Bytes({ 0x49, 0x8B, 0x52, uint8_t(offsetof(Context, entries)) });// mov rdx, [r10+entries]
+	Bytes({ 0xFF, 0x24, 0xC2 });// jmp [rdx+rax*8]
+}
+
+void Jit::Byte(uint8_t value)
+{
+	arena[arenaUsed++] = value;
+}
+
+void Jit::Bytes(std::initializer_list<uint8_t> values)
+{
+	for (uint8_t value : values)
+	{
+		Byte(value);
+	}
+}
+
+void Jit::Rel32(uint8_t const* target)
+{
+	int32_t offset = static_cast<int32_t>(target - (arena + arenaUsed + 4));
+	Bytes({ uint8_t(offset), uint8_t(offset >> 8), uint8_t(offset >> 16), uint8_t(offset >> 24) });
+}
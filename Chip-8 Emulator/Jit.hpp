@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include "Chip8.hpp"
+
+// Basic-block compiler from CHIP-8 to x86-64. A block is the longest straight
+// run of register-only instructions (6xkk, 7xkk, 8xyN, Annn, Fx07, Fx1E, Fx29)
+// from a pc, closed by a jump, call, return or skip (1nnn, 2nnn, 00EE, 3xkk,
+// 4xkk, 5xy0, 9xy0) that is compiled too. Blocks jump straight to each other
+// through a table of entry points, counting the cycles they run against the
+// batch, so control only comes back to C++ at an instruction that has to be
+// interpreted: one touching memory, the display, the keypad or the timers, an
+// Fx07 after the next timer tick, or a jump that may close an idle loop. Those
+// run through Chip8::Cycle(), which is also the fallback on hosts without
+// x86-64 support.
+class Jit
+{
+public:
+	explicit Jit(Chip8& chip8);
+	~Jit();
+
+	// True when native code can be generated on this host
+	static bool Supported();
+
+	// Runs up to n cycles and stops early on an event or at an instruction with
+	// no native code, which the caller interprets; returns the cycles run
+	unsigned int Run(unsigned int n);
+	// True when the instruction at address is known to have no native code, so
+	// the caller can interpret it without going through Run()
+	bool Interprets(uint16_t address) const
+	{
+		return address > chip8.addressMask || (blocks[address].compiled && !blocks[address].code);
+	}
+	// Drops every block compiled from memory[address, address + length)
+	void Invalidate(uint16_t address, unsigned int length);
+	// Drops every compiled block
+	void Flush();
+
+	// Differential mode: every native block is re-run on the interpreter
+	// and the two register states are compared
+	void SetVerify(bool enabled) { verify = enabled; }
+	unsigned long long Mismatches() const { return mismatches; }
+
+private:
+	// What native code reads and updates while it runs; r10 points at it
+	struct Context
+	{
+		uint8_t* registers;// kept in r8
+		uint16_t* index;// kept in r9
+		uint16_t* stack;
+		uint8_t* sp;
+		uint8_t const* const* entries;// native entry point of each address, or the exit stub
+		uint32_t cycles;// run so far, kept in r11d
+		uint32_t limit;// cycles the batch has left
+		uint32_t tick;// cycles until the next timer tick, after which Fx07 has to be interpreted
+		uint8_t delayTimer;// as it stands until that tick
+		uint8_t idleLoops;// 1nnn that could close an idle loop has to be interpreted
+	};
+
+	// Enters native code at code, returning the pc it stopped at, with INTERPRET
+	// set when the instruction there has to run on the interpreter
+	typedef uint32_t (*EnterFunc)(Context* context, uint8_t const* code);
+	static const uint32_t INTERPRET = 1u << 16;
+
+	struct Block
+	{
+		uint8_t const* code;// nullptr when the block has no native instructions
+		uint16_t count;// native instructions in the block, including a compiled jump, call, return or skip
+		uint16_t size;// bytes from start it was compiled from, which a write to drops it
+		bool compiled;
+	};
+
+	// How an instruction is compiled: run inside the block, closing it, or left to the interpreter
+	enum class Kind
+	{
+		Straight,
+		Branch,
+		Interpreted
+	};
+
+	Kind Classify(uint16_t address) const;
+	void Compile(uint16_t start);
+	// Emits one instruction, position instructions into a block of count
+	void Emit(uint16_t address, unsigned int position, unsigned int count);
+	// Leaves native code at pc, backing the cycle count out by notRun instructions of the block
+	void EmitExit(uint32_t pc, unsigned int notRun);
+	// Carries on at target, which has to be inside memory
+	void EmitDispatch(uint16_t target);
+	// Runs native code from block for at most limit cycles, returning what EnterFunc does
+	uint32_t RunNative(Block const& block, unsigned int limit);
+	uint32_t RunVerified(Block const& block);
+	void EmitStubs();
+
+	void Byte(uint8_t value);
+	void Bytes(std::initializer_list<uint8_t> values);
+	// A 32-bit displacement to target from the end of it
+	void Rel32(uint8_t const* target);
+
+	static const unsigned int PAGE_SIZE = 256;
+	static const unsigned int MAX_BLOCK_LENGTH = 64;
+	static const size_t MAX_INSTRUCTION_BYTES = 40;// longest Emit sequence is 40 bytes, for 00EE
+	static const size_t BLOCK_OVERHEAD_BYTES = 40;// the cycle check on entry and the exit after the last instruction
+	static const size_t ARENA_SIZE = 1u << 20;
+
+	Chip8& chip8;
+	// Enough for XO-CHIP's 64 KB; the other profiles only use the first 4 KB
+	Block blocks[XO_MEMORY_SIZE]{};
+	uint8_t const* entries[XO_MEMORY_SIZE]{};
+	std::vector<uint16_t> pages[XO_MEMORY_SIZE / PAGE_SIZE];// starts of the blocks overlapping each page
+
+	uint8_t* arena{};// executable memory for compiled blocks
+	size_t arenaUsed{};
+	size_t stubsSize{};// the start of the arena holds the entry trampoline and the exit stub
+	EnterFunc enter{};
+	uint8_t const* exitStub{};
+	Context context{};
+
+	bool verify{};
+	unsigned long long mismatches{};
+};
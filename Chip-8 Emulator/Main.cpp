@@ -1,57 +1,208 @@
+#include "Audio.hpp"
 #include "Chip8.hpp"
+#include "FramePacer.hpp"
 #include "Platform.hpp"
-#include <chrono>
+#include "Replay.hpp"
+#include "Rewind.hpp"
+#include "Trace.hpp"
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
 
 
 int main(int argc, char** argv)
 {
-	// Check for proper number of command line arguments
-	if (argc != 4)
+	bool unthrottled = false;// Run frames back to back instead of at 60 per second
+	bool mute = false;// Leave the audio device closed
+	char const* recordFilename = nullptr;// Where to save a replay of the session
+	char const* traceFilename = nullptr;// Where to write an instruction trace
+	RandomSource randomSource = RandomSource::Pcg;// Generator behind Cxkk
+	QuirkProfile quirks = QuirkProfile::Default;// Dialect the ROM was written for
+	bool seeded = false;// Use seed instead of the clock
+	uint64_t seed = 0;
+	bool usage = argc < 4;
+
+	// Options after the three positional arguments
+	for (int i = 4; i < argc && !usage; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--unthrottled")
+		{
+			unthrottled = true;
+		}
+		else if (arg == "--mute")
+		{
+			mute = true;
+		}
+		else if (arg == "--record" && i + 1 < argc)
+		{
+			recordFilename = argv[++i];
+		}
+		else if (arg == "--trace" && i + 1 < argc)
+		{
+			traceFilename = argv[++i];
+		}
+		else if (arg == "--seed" && i + 1 < argc)
+		{
+			seed = std::stoull(argv[++i]);
+			seeded = true;
+		}
+		else if (arg == "--rng" && i + 1 < argc)
+		{
+			usage = !ParseRandomSource(argv[++i], randomSource);
+		}
+		else if (arg == "--quirks" && i + 1 < argc)
+		{
+			usage = !ParseQuirkProfile(argv[++i], quirks);
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	// Check for proper command line arguments
+	if (usage)
 	{
-		std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+		std::cerr << "Usage: " << argv[0] << " <Scale> <ClockHz> <ROM> [--unthrottled] [--mute] [--record <File>] [--seed <N>]"
+			<< " [--rng pcg|xorshift|minstd] [--quirks default|vip|chip48|schip|xochip] [--trace <File>]\n";
 		std::exit(EXIT_FAILURE);
 	}
 
 	int videoScale = std::stoi(argv[1]);// Scale factor for screen rendering
-	int cycleDelay = std::stoi(argv[2]);// Delay between CPU cycles in milliseconds
+	uint32_t clockHz = std::stoul(argv[2]);// Emulated CPU clock in instructions per second
 	char const* romFilename = argv[3];// Path to the ROM file
 
+	// Sound changes from this thread to the audio callback; made first so it outlives the audio device
+	SoundEventRing soundRing;
+	SoundFeed soundFeed(soundRing);
+
 	Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
+	if (!mute && !platform.OpenAudio(soundRing))
+	{
+		std::cerr << "No audio device, running without sound\n";
+	}
 
 	// Instantiate the Chip8 emulator and load the ROM into memory
 	Chip8 chip8;
-	chip8.LoadROM(romFilename);
-
-	// Calculate the pitch (bytes per row) of the video memory
-	int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
+	chip8.SetQuirks(quirks);
+	if (!chip8.LoadROM(romFilename))
+	{
+		std::cerr << "Cannot read ROM " << romFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+	chip8.SetClockHz(clockHz);
+	chip8.SetRandom(randomSource, seeded ? seed : chip8.Seed());
 
-	// Used to track when to execute theh next CPU cycle
-	auto lastCycleTime = std::chrono::high_resolution_clock::now();
+	// One frame of emulated time per 60 Hz tick of the timers, paced by sleeping between frames
+	FramePacer pacer(TIMER_HZ);
 	bool quit = false;// Flag to check when to exit the loop
 
+	// Every frame is recorded so holding Backspace steps back through them; at a few
+	// hundred bytes a frame this holds well over an hour of history
+	RewindBuffer rewind(16 * 1024 * 1024);
+
+	// Seed, clock and every key change, so the session can be replayed headless
+	Recorder recorder;
+	if (recordFilename)
+	{
+		recorder.Start(chip8, romFilename);
+	}
+
+	// Every instruction into a binary trace, written out by a background thread
+	std::unique_ptr<TraceWriter> trace;
+	if (traceFilename)
+	{
+		trace.reset(new TraceWriter());
+		if (!trace->Open(traceFilename, clockHz))
+		{
+			std::cerr << "Cannot write trace " << traceFilename << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		chip8.SetTrace(trace.get());
+	}
+
 	// Main emulation loop
 	while (!quit)
 	{
 		// Poll input and update the emulator's keypad state
 		quit = platform.ProcessInput(chip8.keypad);
 
-		// Get the current time
-		auto currentTime = std::chrono::high_resolution_clock::now();
+		if (platform.RewindHeld())
+		{
+			// Go back one frame, keeping the keys as they are now rather than as they were then
+			uint8_t keys[KEY_COUNT];
+			memcpy(keys, chip8.keypad, sizeof(keys));
+			rewind.StepBack(chip8);
+			memcpy(chip8.keypad, keys, sizeof(keys));
+			soundFeed.Update(chip8);
+
+			if (recordFilename)
+			{
+				recorder.Truncate(chip8);
+			}
+		}
+		else
+		{
+			if (recordFilename)
+			{
+				recorder.CaptureKeys(chip8);
+			}
+
+			// Run the whole frame; RunFrame returns early on events, so keep going until the frame is over
+			RunResult result;
+			do
+			{
+				result = chip8.RunFrame();
+				soundFeed.Update(chip8);// A batch ends where the sound timer starts, so the beep starts on its cycle
+			} while (!(result.events & EVENT_FRAME_END));
 
-		// Compute the time difference in milliseconds between current and last cycle
-		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
+			rewind.Push(chip8);
 
-		// Only run a new cycle if enough time has passed
-		if (dt > cycleDelay)
+			if (recordFilename)
+			{
+				recorder.EndFrame(chip8);
+			}
+		}
+
+		platform.SetResolution(chip8.VideoWidth(), chip8.VideoHeight());// 128x64 while a SUPER-CHIP ROM is in that mode
+		platform.Update(chip8.video[0], chip8.VideoPlanes() > 1 ? chip8.video[1] : nullptr, chip8.FrameGeneration());// Render the display to the screen if it changed
+
+		// Sleep until the next frame is due
+		if (!unthrottled)
 		{
-			lastCycleTime = currentTime;// Update the last cycle time
+			pacer.WaitForNextFrame();
+		}
+	}
+
+	rewind.Report(std::cout);
 
-			chip8.Cycle();// Execute one CHIP-8 CPU cycle
+	if (recordFilename && !recorder.Save(recordFilename))
+	{
+		std::cerr << "Cannot write recording " << recordFilename << "\n";
+	}
 
-			platform.Update(chip8.video, videoPitch);// Render the display to the screen
+	if (trace)
+	{
+		chip8.SetTrace(nullptr);
+		if (!trace->Close())
+		{
+			std::cerr << "Cannot write trace " << traceFilename << "\n";
 		}
+		std::cout << "trace " << trace->Records() << " instructions, " << trace->Stalls() << " stalls\n";
 	}
 
+	// Pacing jitter for the session
+	if (!unthrottled)
+	{
+		pacer.Report(std::cout);
+	}
+
+#if defined(CHIP8_PROFILE)
+	chip8.GetProfiler().Report(std::cout);
+#endif
+
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "NullPlatform.hpp"
+#include "Audio.hpp"
+#include "Chip8.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+bool NullPlatform::LoadScript(char const* filename)
+{
+	std::ifstream file(filename);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos)
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		uint64_t frame;
+		unsigned int key;
+		std::string state;
+
+		if (!(fields >> frame >> std::hex >> key >> state) || key >= KEY_COUNT || (state != "down" && state != "up"))
+		{
+			return false;
+		}
+
+		script.push_back(KeyEvent{ frame, static_cast<uint8_t>(key), static_cast<uint8_t>(state == "down") });
+	}
+
+	// Keep lines for the same frame in file order
+	std::stable_sort(script.begin(), script.end(), [](KeyEvent const& a, KeyEvent const& b) { return a.frame < b.frame; });
+
+	return true;
+}
+
+bool NullPlatform::Update(uint64_t const* plane0, uint64_t const* plane1, uint32_t generation)
+{
+	if (presentedAny && generation == presentedGeneration)
+	{
+		return false;
+	}
+
+	presentedGeneration = generation;
+	presentedAny = true;
+	++presented;
+
+	lastHash = HashFrame(plane0, frameWords);
+	if (plane1)
+	{
+		lastHash = HashFrame(plane1, frameWords, lastHash);
+	}
+
+	return true;
+}
+
+void NullPlatform::SetResolution(int width, int height)
+{
+	int words = (width + 63) / 64 * height;
+
+	// A frame of another size has to be presented even if its generation was seen
+	if (words != frameWords)
+	{
+		frameWords = words;
+		presentedAny = false;
+	}
+}
+
+bool NullPlatform::ProcessInput(uint8_t* keys)
+{
+	while (nextEvent < script.size() && script[nextEvent].frame <= frame)
+	{
+		keys[script[nextEvent].key] = script[nextEvent].down;
+		++nextEvent;
+	}
+
+	++frame;
+
+	return false;
+}
+
+void NullPlatform::RunFrame(Chip8& chip8, uint64_t cycleLimit)
+{
+	ProcessInput(chip8.keypad);
+
+	Scheduler const& scheduler = chip8.GetScheduler();
+	uint64_t ticks = scheduler.Ticks();
+
+	// RunCycles returns early on events, so keep going until the tick
+	while (scheduler.Ticks() == ticks && (cycleLimit == 0 || scheduler.Cycles() < cycleLimit))
+	{
+		uint64_t budget = scheduler.CyclesUntilTick();
+		if (cycleLimit != 0 && cycleLimit - scheduler.Cycles() < budget)
+		{
+			budget = cycleLimit - scheduler.Cycles();
+		}
+
+		chip8.RunCycles(static_cast<unsigned int>(budget));
+
+		if (soundFeed)
+		{
+			soundFeed->Update(chip8);
+		}
+	}
+
+	SetResolution(chip8.VideoWidth(), chip8.VideoHeight());
+	Update(chip8.video[0], chip8.VideoPlanes() > 1 ? chip8.video[1] : nullptr, chip8.FrameGeneration());
+}
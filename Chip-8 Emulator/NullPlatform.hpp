@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+class SoundFeed;
+
+// Stand-in for Platform with no window, no SDL and no delays. Input comes from an
+// optional script and presented frames are only hashed, so ROMs can run headless.
+//
+// Script lines are "<frame> <key> <down|up>" with the key in hex (0-F), applied
+// at the start of that frame; blank lines and lines starting with # are ignored.
+class NullPlatform
+{
+public:
+	// Returns false if the script cannot be read or has a malformed line
+	bool LoadScript(char const* filename);
+
+	// Hashes the frame, plane 0 and then plane 1 if there is one, if its generation
+	// changed; returns true when it did
+	bool Update(uint64_t const* plane0, uint64_t const* plane1, uint32_t generation);
+	// Size of the frames Update is given from now on, 64x32 to start with
+	void SetResolution(int width, int height);
+	// Applies the scripted key changes due this frame and advances the frame count;
+	// returns true once the script has asked to quit (it never does by itself)
+	bool ProcessInput(uint8_t* keys);
+
+	// One headless frame: input, then the machine up to the next timer tick or until its
+	// clock reaches cycleLimit (0 for no limit), then the frame hash
+	void RunFrame(Chip8& chip8, uint64_t cycleLimit);
+	// Updates feed after every batch RunFrame runs, so sound changes are stamped with their cycle
+	void SetSoundFeed(SoundFeed* feed) { soundFeed = feed; }
+
+	uint64_t Frame() const { return frame; }
+	uint64_t LastFrameHash() const { return lastHash; }
+	uint64_t FramesPresented() const { return presented; }
+
+private:
+	struct KeyEvent
+	{
+		uint64_t frame;
+		uint8_t key;
+		uint8_t down;
+	};
+
+	std::vector<KeyEvent> script;
+	size_t nextEvent{};
+	uint64_t frame{};
+
+	int frameWords{VIDEO_HEIGHT};// 64-bit words per frame
+	uint64_t lastHash{};
+	uint64_t presented{};
+	uint32_t presentedGeneration{};
+	bool presentedAny{};
+	SoundFeed* soundFeed{};
+};
@@ -2,32 +2,151 @@
 #include <glad/glad.h>
 #include <SDL2/SDL.h>
 // Constructor: This sets ups the SDL window, renderer, and streaming texture used to display the CHIP-8 emulator's video output
-Platform::Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight)
+Platform::Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight, int upscale, bool hidden)
+	: textureWidth(textureWidth), textureHeight(textureHeight), upscale(upscale < 1 ? 1 : (upscale > MAX_SCALE ? MAX_SCALE : upscale)),
+	  expandKernel(&BestExpandKernel())
 {
 	// Initialize SDL's video subsystem
 	SDL_Init(SDL_INIT_VIDEO);
 	// Create an SDL window with the given title and size, positioned at (200, 200) on screen
-	window = SDL_CreateWindow(title, 200, 200, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
+	window = SDL_CreateWindow(title, 200, 200, windowWidth, windowHeight, hidden ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
 	// Create a hardware-accelerated renderer for the window
 	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 	// Create a streaming texture used to upload pixel data each frame
-	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth * this->upscale, textureHeight * this->upscale);
+
+	// Presents are limited to one per refresh of the display the window is on, 60 Hz if unknown
+	SDL_DisplayMode mode{};
+	int refreshRate = 60;
+	if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0)
+	{
+		refreshRate = mode.refresh_rate;
+	}
+	refreshPeriod = SDL_GetPerformanceFrequency() / refreshRate;
 }
 // Destructor: Cleans up SDL resources
 Platform::~Platform()
 {
+	if (audioDevice)
+	{
+		SDL_CloseAudioDevice(audioDevice);// Stop the callback before the synth goes
+	}
 	SDL_DestroyTexture(texture);// Destroy the SDL texture
 	SDL_DestroyRenderer(renderer);// Destroy the SDL renderer
 	SDL_DestroyWindow(window);// Destroy the SDL window
 	SDL_Quit();// Quit SDL
 }
-// Updates the screen by copying the emulator's framebuffer to the SDL texture and rendering it
-void Platform::Update(void const* buffer, int pitch)
+// Updates the screen by copying the emulator's framebuffer to the SDL texture and rendering it,
+// skipping the upload entirely when the frame has not changed
+bool Platform::Update(uint64_t const* plane0, uint64_t const* plane1, uint32_t generation)
 {
-	SDL_UpdateTexture(texture, nullptr, buffer, pitch);// Update SDL texture with new video buffer
+	// Nothing was drawn since the last present
+	if (presentedAny && generation == presentedGeneration)
+	{
+		return false;
+	}
+
+	// Presented less than half a refresh ago; keep the frame pending. Frames paced at
+	// the refresh rate arrive a period apart give or take jitter, so a whole period
+	// would hold back every frame that finished a little early
+	uint64_t now = SDL_GetPerformanceCounter();
+	if (presentedAny && limitToRefresh && now - lastPresentTime < refreshPeriod / 2)
+	{
+		return false;
+	}
+
+	lastPresentTime = now;
+	presentedGeneration = generation;
+	presentedAny = true;
+
+	// Expand the packed rows to RGBA through the palette, straight into the texture memory
+	void* locked;
+	int lockedPitch;
+	if (SDL_LockTexture(texture, nullptr, &locked, &lockedPitch) == 0)
+	{
+		int wordsPerRow = (textureWidth + 63) / 64;
+		uint32_t* pixels = static_cast<uint32_t*>(locked);
+
+		if (plane1)
+		{
+			expandKernel->composite(plane0, plane1, wordsPerRow, textureWidth, textureHeight, palette, upscale, pixels, lockedPitch);
+		}
+		else
+		{
+			expandKernel->expand(plane0, wordsPerRow, textureWidth, textureHeight, palette, upscale, pixels, lockedPitch);
+		}
+		SDL_UnlockTexture(texture);
+	}
+
 	SDL_RenderClear(renderer);// Clear the screen
 	SDL_RenderCopy(renderer, texture, nullptr, nullptr);// Copy texture to renderer
 	SDL_RenderPresent(renderer);// Present the rendered image to the screen
+
+	return true;
+}
+// Recreates the streaming texture at the new framebuffer size; the window keeps its size
+void Platform::SetResolution(int width, int height)
+{
+	if (width == textureWidth && height == textureHeight)
+	{
+		return;
+	}
+
+	textureWidth = width;
+	textureHeight = height;
+	SDL_DestroyTexture(texture);
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth * upscale, textureHeight * upscale);
+	presentedAny = false;
+}
+// Sets the colours used when expanding the framebuffer and forces the next Update to present
+void Platform::SetPalette(uint32_t off, uint32_t on)
+{
+	palette[0] = off;
+	palette[1] = on;
+	presentedAny = false;
+}
+// Sets the four colours two planes composite through
+void Platform::SetPalette(uint32_t const colours[4])
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		palette[i] = colours[i];
+	}
+	presentedAny = false;
+}
+// Opens the default audio device as 16-bit mono with small buffers and starts the callback
+bool Platform::OpenAudio(SoundEventRing& ring)
+{
+	if (audioDevice || SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+	{
+		return audioDevice != 0;
+	}
+
+	SDL_AudioSpec desired{};
+	desired.freq = AUDIO_SAMPLE_RATE;
+	desired.format = AUDIO_S16SYS;
+	desired.channels = 1;
+	desired.samples = AUDIO_BUFFER_SAMPLES;
+	desired.callback = &Platform::AudioCallback;
+	desired.userdata = this;
+
+	// SDL converts to whatever format the device wants, but the synth renders at the device's own rate
+	SDL_AudioSpec obtained{};
+	audioDevice = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+	if (!audioDevice)
+	{
+		return false;
+	}
+
+	synth.reset(new SoundSynth(ring, obtained.freq));// Made before the callback can first run
+	SDL_PauseAudioDevice(audioDevice, 0);// Start playing
+	return true;
+}
+// Fills the device's buffer from the synth; nothing here locks or allocates
+void Platform::AudioCallback(void* userdata, Uint8* stream, int length)
+{
+	Platform* platform = static_cast<Platform*>(userdata);
+	platform->synth->Render(reinterpret_cast<int16_t*>(stream), static_cast<unsigned int>(length) / sizeof(int16_t));
 }
 // Processes SDL events, updates keypad states, and returns whether the emulator should quit
 bool Platform::ProcessInput(uint8_t* keys)
@@ -134,6 +253,11 @@ bool Platform::ProcessInput(uint8_t* keys)
 					{
 						keys[0xF] = 1;
 					} break;
+
+					case SDLK_BACKSPACE:
+					{
+						rewindHeld = true;
+					} break;
 				}
 			} break;
 
@@ -220,6 +344,11 @@ bool Platform::ProcessInput(uint8_t* keys)
 					{
 						keys[0xF] = 0;
 					} break;
+
+					case SDLK_BACKSPACE:
+					{
+						rewindHeld = false;
+					} break;
 				}
 			} break;
 		}
@@ -1,8 +1,11 @@
 #pragma once// Ensures the header is only included once during compilation
 
 #include <cstdint>
+#include <memory>
 #include <SDL2/SDL.h>
 #include <glad/glad.h>
+#include "Audio.hpp"
+#include "Video.hpp"
 
 // Platform class manages window creation, rendering, OpenGL context, and input handling
 class Platform
@@ -11,19 +14,60 @@ class Platform
 	friend class Imgui;
 
 public:
-	// Constructor: Initializes SDL, creates a window and OpenGL context, sets up rendering
-	Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight);
+	// Constructor: Initializes SDL, creates a window and OpenGL context, sets up rendering.
+	// upscale > 1 makes the CPU scale the frame by that integer factor (up to MAX_SCALE)
+	// while expanding it, instead of leaving all of the scaling to the renderer.
+	// A hidden window renders without showing anything, for benchmarks.
+	Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight, int upscale = 1, bool hidden = false);
 	// Destructor: Cleans up SDL and OpenGL resources
 	~Platform();
-	// Updates the screen with new framebuffer data
-	void Update(void const* buffer, int pitch);
+	// Presents the framebuffer if its generation changed since the last present and at least
+	// half a display refresh has passed since then; returns true when a frame was presented.
+	// A frame held back by the refresh limit is presented by a later call.
+	// The framebuffer is one bit per pixel, a 64-bit word per row with column 0 in the most
+	// significant bit; it is expanded to RGBA through the palette only when presented.
+	// With a second plane (XO-CHIP) the two are composited through the four colour
+	// palette instead; plane1 is null for a single plane.
+	bool Update(uint64_t const* plane0, uint64_t const* plane1, uint32_t generation);
+	// Resizes the texture when the framebuffer changes size (SUPER-CHIP 128x64 mode), so
+	// frames are expanded at their own resolution and stretched to the window; the next
+	// Update presents whatever its generation
+	void SetResolution(int width, int height);
+	// Switches the once-per-refresh limit on Update; with it off every changed frame is presented
+	void SetRefreshLimit(bool enabled) { limitToRefresh = enabled; }
+	// Sets the RGBA8888 colours used for pixels that are off and on
+	void SetPalette(uint32_t off, uint32_t on);
+	// Sets all four colours, indexed by plane 0 bit + 2 * plane 1 bit; the first two are off and on
+	void SetPalette(uint32_t const colours[4]);
+	// Starts sound: an SDL audio callback plays what ring receives through a SoundSynth, with
+	// buffers of AUDIO_BUFFER_SAMPLES, about 5 ms each at AUDIO_SAMPLE_RATE. Returns
+	// false when no audio device opens, and the emulator runs silent
+	bool OpenAudio(SoundEventRing& ring);
 	// Processes keyboard input and maps key states into the keys array
 	bool ProcessInput(uint8_t* keys);
+	// True while the rewind key (Backspace) is held down
+	bool RewindHeld() const { return rewindHeld; }
 
 private:
+	// Runs on SDL's audio thread
+	static void AudioCallback(void* userdata, Uint8* stream, int length);
+
 	SDL_Window* window{};// Pointer to the SDL window
 	SDL_GLContext gl_context{};// OpenGL rendering context created by SDL
 	GLuint framebuffer_texture;// OpenGL texture used as a framebuffer for rendering pixels
 	SDL_Renderer* renderer{};// SDL renderer for drawing to the window
 	SDL_Texture* texture{};// SDL texture used for blitting pixel data to the screen
+	int textureWidth{};// Width of the texture in pixels
+	int textureHeight{};// Height of the texture in pixels
+	int upscale{};// Integer scale applied on the CPU when expanding the framebuffer
+	uint32_t palette[4]{ 0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF };// RGBA8888 colours for off, on, and XO-CHIP's plane 1 and both planes
+	ExpandKernel const* expandKernel{};// Fastest 1bpp to RGBA kernel for this CPU
+	uint64_t refreshPeriod{};// Display refresh interval in performance counter ticks
+	uint64_t lastPresentTime{};// Performance counter value at the last present
+	uint32_t presentedGeneration{};// Generation of the frame on screen
+	bool presentedAny{};// False until the first frame is presented
+	bool limitToRefresh{true};// Presents at least half a display refresh apart
+	bool rewindHeld{};// Backspace is down
+	SDL_AudioDeviceID audioDevice{};// Zero while there is no sound output
+	std::unique_ptr<SoundSynth> synth;// Renders the samples the audio callback asks for
 };
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <vector>
+
+namespace
+{
+	// Heat map layout: each character covers one two-byte instruction slot
+	const unsigned int HEAT_ROW_BYTES = 128;
+	const char HEAT_RAMP[] = " .:-=+*#%@";
+	const unsigned int HEAT_LEVELS = sizeof(HEAT_RAMP) - 1;
+
+	const unsigned int HOT_PC_COUNT = 16;
+
+	double Share(uint64_t count, uint64_t total)
+	{
+		return total ? 100.0 * count / total : 0.0;
+	}
+}
+
+void Profiler::Clear()
+{
+	memset(counts, 0, sizeof(counts));
+	memset(ticks, 0, sizeof(ticks));
+	std::fill(pcCounts.begin(), pcCounts.end(), 0);
+	std::fill(pcOpcodes.begin(), pcOpcodes.end(), 0);
+	total = 0;
+}
+
+void Profiler::OpName(unsigned int op, char name[5])
+{
+	static const char* const families[16] = {
+		"0nnn", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+		"8xy?", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex??", "Fx??"
+	};
+
+	if (op < GROUP0)
+	{
+		memcpy(name, families[op], 5);
+	}
+	else if (op < GROUP0_SUPER)
+	{
+		// Decoded by low nibble alone: every 0nn0 clears and every 0nnE returns
+		unsigned int nibble = op - GROUP0;
+		snprintf(name, 5, nibble == 0x0 || nibble == 0xE ? "00E%X" : "0nn%X", nibble & 0xFu);
+	}
+	else if (op < GROUP8)
+	{
+		// 00Cn, 00E0, 00EE and 00FB-00FF; anything else is a 0nnn machine call
+		unsigned int low = op - GROUP0_SUPER;
+		bool used = (low & 0xF0u) == 0xC0u || low == 0xE0 || low == 0xEE || low >= 0xFB;
+		snprintf(name, 5, used ? "00%02X" : "0n%02X", low & 0xFFu);
+	}
+	else if (op < GROUPE)
+	{
+		snprintf(name, 5, "8xy%X", (op - GROUP8) & 0xFu);
+	}
+	else if (op < GROUPF)
+	{
+		snprintf(name, 5, "Ex%X%X", op - GROUPE == 0xE ? 0x9 : 0xA, (op - GROUPE) & 0xFu);
+	}
+	else
+	{
+		snprintf(name, 5, "Fx%02X", (op - GROUPF) & 0xFFu);
+	}
+}
+
+void Profiler::Report(std::ostream& out) const
+{
+	std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(2);
+
+	out << "profile " << total << " instructions\n";
+
+	// Families first, the grouped ones summed over their sub-opcodes
+	uint64_t familyCounts[16];
+	uint64_t familyTicks[16];
+	for (unsigned int f = 0; f < 16; ++f)
+	{
+		familyCounts[f] = counts[f];
+		familyTicks[f] = ticks[f];
+	}
+	for (unsigned int op = GROUP0; op < OP_COUNT; ++op)
+	{
+		unsigned int family = op < GROUP8 ? 0x0 : op < GROUPE ? 0x8 : op < GROUPF ? 0xE : 0xF;
+		familyCounts[family] += counts[op];
+		familyTicks[family] += ticks[op];
+	}
+
+	out << "family   count        share   ticks/op\n";
+	for (unsigned int f = 0; f < 16; ++f)
+	{
+		if (familyCounts[f])
+		{
+			out << std::hex << std::uppercase << "  " << f << "    " << std::dec << std::nouppercase << std::setw(12) << familyCounts[f] << " "
+				<< std::setw(6) << Share(familyCounts[f], total) << "%  " << std::setw(8) << double(familyTicks[f]) / familyCounts[f] << "\n";
+		}
+	}
+
+	// Every instruction, hottest first
+	std::vector<unsigned int> ops;
+	for (unsigned int op = 0; op < OP_COUNT; ++op)
+	{
+		if (counts[op])
+		{
+			ops.push_back(op);
+		}
+	}
+	std::sort(ops.begin(), ops.end(), [this](unsigned int a, unsigned int b) { return counts[a] > counts[b]; });
+
+	out << "op       count        share   ticks/op  share of ticks\n";
+
+	uint64_t totalTicks = 0;
+	for (unsigned int op = 0; op < OP_COUNT; ++op)
+	{
+		totalTicks += ticks[op];
+	}
+
+	for (unsigned int op : ops)
+	{
+		char name[5];
+		OpName(op, name);
+
+		out << "  " << name << " " << std::setw(12) << counts[op] << " " << std::setw(6) << Share(counts[op], total) << "%  "
+			<< std::setw(8) << double(ticks[op]) / counts[op] << "  " << std::setw(6) << Share(ticks[op], totalTicks) << "%\n";
+	}
+
+	// Hottest addresses with the instruction found there
+	std::vector<unsigned int> pcs;
+	for (unsigned int pc = 0; pc < ADDRESS_COUNT; ++pc)
+	{
+		if (pcCounts[pc])
+		{
+			pcs.push_back(pc);
+		}
+	}
+	size_t hot = std::min<size_t>(HOT_PC_COUNT, pcs.size());
+	std::partial_sort(pcs.begin(), pcs.begin() + hot, pcs.end(), [this](unsigned int a, unsigned int b) { return pcCounts[a] > pcCounts[b]; });
+
+	out << "pc        count        share   opcode\n";
+	out << std::hex << std::setfill('0');
+	for (size_t i = 0; i < hot; ++i)
+	{
+		unsigned int pc = pcs[i];
+		out << "  " << std::setw(4) << pc << "  " << std::dec << std::setfill(' ') << std::setw(12) << pcCounts[pc] << " " << std::setw(6)
+			<< Share(pcCounts[pc], total) << "%  " << std::hex << std::setfill('0') << std::setw(4) << pcOpcodes[pc] << "\n";
+	}
+	out << std::dec << std::setfill(' ');
+
+	// Heat map: one row per HEAT_ROW_BYTES of memory, rows nothing ran in left out,
+	// brightness on a log scale so cold code still shows against the hot loop
+	uint64_t hottest = 0;
+	for (unsigned int slot = 0; slot < ADDRESS_COUNT / 2; ++slot)
+	{
+		hottest = std::max(hottest, pcCounts[2 * slot] + pcCounts[2 * slot + 1]);
+	}
+
+	out << "heat map, " << HEAT_ROW_BYTES << " bytes per row, '" << HEAT_RAMP[1] << "' ran once to '" << HEAT_RAMP[HEAT_LEVELS - 1] << "' ran "
+		<< hottest << " times\n";
+
+	for (unsigned int row = 0; row < ADDRESS_COUNT; row += HEAT_ROW_BYTES)
+	{
+		char line[HEAT_ROW_BYTES / 2 + 1];
+		bool ran = false;
+
+		for (unsigned int slot = 0; slot < HEAT_ROW_BYTES / 2; ++slot)
+		{
+			uint64_t count = pcCounts[row + 2 * slot] + pcCounts[row + 2 * slot + 1];
+			unsigned int level = 0;
+
+			if (count)
+			{
+				double scale = hottest > 1 ? std::log(double(count)) / std::log(double(hottest)) : 1.0;
+				level = 1 + static_cast<unsigned int>(scale * (HEAT_LEVELS - 2) + 0.5);
+				ran = true;
+			}
+
+			line[slot] = HEAT_RAMP[level];
+		}
+
+		line[HEAT_ROW_BYTES / 2] = '\0';
+
+		if (ran)
+		{
+			out << "  " << std::hex << std::setfill('0') << std::setw(4) << row << std::dec << std::setfill(' ') << " |" << line << "|\n";
+		}
+	}
+
+	out.flags(flags);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CHIP8_PROFILE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CHIP8_PROFILE_TSC 1
+#else
+#include <chrono>
+#endif
+
+// Per-instruction execution counts and host time, for finding which handlers
+// dominate a ROM. Chip8 only has one when built with CHIP8_PROFILE defined (in
+// every translation unit, since it changes the class layout); otherwise none of
+// this is compiled into the interpreter. Counts are kept per opcode family, per
+// sub-opcode of the 0, 8, E and F groups, and per PC. Host ticks include reading
+// the clock twice, so they rank handlers against each other rather than giving
+// their absolute cost.
+class Profiler
+{
+public:
+	// Host time stamp: the time-stamp counter on x86, nanoseconds elsewhere
+	static uint64_t Now()
+	{
+#if defined(CHIP8_PROFILE_TSC)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// Counts one execution of opcode at pc that took ticks of host time
+	void Record(uint16_t pc, uint16_t opcode, uint64_t ticks)
+	{
+		unsigned int op = OpIndex(opcode);
+		++counts[op];
+		this->ticks[op] += ticks;
+
+		++pcCounts[pc & (ADDRESS_COUNT - 1)];
+		pcOpcodes[pc & (ADDRESS_COUNT - 1)] = opcode;
+		++total;
+	}
+
+	void Clear();
+	uint64_t Instructions() const { return total; }
+	// With the SUPER-CHIP instructions on, group 0 is told apart by its low byte, as
+	// Chip8's tables decode it; otherwise only the low nibble matters
+	void SetSuperChip(bool enabled) { superChip = enabled; }
+
+	// Instructions sorted by count with their share and mean host ticks, the
+	// hottest PCs, and a heat map of executed addresses
+	void Report(std::ostream& out) const;
+
+private:
+	static const unsigned int ADDRESS_COUNT = 65536;// all of XO-CHIP's memory
+	// One slot per family, then the 0, 8 and E groups by low nibble, group 0 again by
+	// low byte for SUPER-CHIP, and the F group by low byte
+	static const unsigned int GROUP0 = 16;
+	static const unsigned int GROUP0_SUPER = GROUP0 + 16;
+	static const unsigned int GROUP8 = GROUP0_SUPER + 256;
+	static const unsigned int GROUPE = GROUP8 + 16;
+	static const unsigned int GROUPF = GROUPE + 16;
+	static const unsigned int OP_COUNT = GROUPF + 256;
+
+	unsigned int OpIndex(uint16_t opcode) const
+	{
+		switch (opcode >> 12)
+		{
+			case 0x0: return superChip ? GROUP0_SUPER + (opcode & 0x00FFu) : GROUP0 + (opcode & 0x000Fu);
+			case 0x8: return GROUP8 + (opcode & 0x000Fu);
+			case 0xE: return GROUPE + (opcode & 0x000Fu);
+			case 0xF: return GROUPF + (opcode & 0x00FFu);
+			default: return opcode >> 12;
+		}
+	}
+
+	// Mnemonic pattern for a slot, e.g. "Dxyn", "8xy4" or "Fx33"
+	static void OpName(unsigned int op, char name[5]);
+
+	uint64_t counts[OP_COUNT]{};
+	uint64_t ticks[OP_COUNT]{};
+	// On the heap: at 640 KB they would not fit on a stack next to the Chip8 holding them
+	std::vector<uint64_t> pcCounts = std::vector<uint64_t>(ADDRESS_COUNT);
+	std::vector<uint16_t> pcOpcodes = std::vector<uint16_t>(ADDRESS_COUNT);// last opcode seen at each address
+	uint64_t total{};
+	bool superChip{};
+};
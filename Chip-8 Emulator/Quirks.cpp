@@ -0,0 +1,64 @@
+#include "Quirks.hpp"
+#include <cstring>
+
+namespace
+{
+	template<typename Quirks>
+	QuirkFlags FlagsOf()
+	{
+		return { Quirks::shiftVy, Quirks::resetVf, Quirks::jumpVx, Quirks::wrapSprites, Quirks::indexIncrement, Quirks::superChip, Quirks::xoChip };
+	}
+
+	struct ProfileName
+	{
+		QuirkProfile profile;
+		char const* name;
+	};
+
+	const ProfileName PROFILE_NAMES[] = {
+		{ QuirkProfile::Default, "default" },
+		{ QuirkProfile::Vip, "vip" },
+		{ QuirkProfile::Chip48, "chip48" },
+		{ QuirkProfile::Schip, "schip" },
+		{ QuirkProfile::XoChip, "xochip" }
+	};
+}
+
+QuirkFlags GetQuirkFlags(QuirkProfile profile)
+{
+	switch (profile)
+	{
+		case QuirkProfile::Vip: return FlagsOf<VipQuirks>();
+		case QuirkProfile::Chip48: return FlagsOf<Chip48Quirks>();
+		case QuirkProfile::Schip: return FlagsOf<SchipQuirks>();
+		case QuirkProfile::XoChip: return FlagsOf<XoChipQuirks>();
+		default: return FlagsOf<DefaultQuirks>();
+	}
+}
+
+bool ParseQuirkProfile(char const* name, QuirkProfile& profile)
+{
+	for (ProfileName const& entry : PROFILE_NAMES)
+	{
+		if (strcmp(name, entry.name) == 0)
+		{
+			profile = entry.profile;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+char const* QuirkProfileName(QuirkProfile profile)
+{
+	for (ProfileName const& entry : PROFILE_NAMES)
+	{
+		if (entry.profile == profile)
+		{
+			return entry.name;
+		}
+	}
+
+	return "default";
+}
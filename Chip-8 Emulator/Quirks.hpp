@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+
+// CHIP-8 dialects whose ROMs expect different behaviour from the same opcodes,
+// chosen per machine
+enum class QuirkProfile
+{
+	Default,// this emulator's own mix, which existing recordings and snapshots assume
+	Vip,// the original COSMAC VIP interpreter
+	Chip48,// CHIP-48 on the HP-48
+	Schip,// SUPER-CHIP 1.1
+	XoChip// XO-CHIP
+};
+
+// What Fx55 and Fx65 leave in I
+enum class IndexIncrement
+{
+	None,// I unchanged
+	X,// I + x, CHIP-48's off-by-one
+	XPlusOne// I + x + 1, one past the last register loaded or stored
+};
+
+// Quirk policies, one per QuirkProfile. The quirk-dependent handlers and the
+// switch loop are templates over these, so every profile is compiled into its
+// own handlers with the quirks folded away rather than tested per instruction.
+struct DefaultQuirks
+{
+	static const bool shiftVy = false;// 8xy6/8xyE shift Vy into Vx, not Vx in place
+	static const bool resetVf = false;// 8xy1-8xy3 clear VF
+	static const bool jumpVx = false;// Bnnn jumps to nnn + Vx, x being the top nibble of nnn, not nnn + V0
+	static const bool wrapSprites = false;// Dxyn wraps pixels past the edges to the far side, not clipping them
+	static const IndexIncrement indexIncrement = IndexIncrement::None;
+	static const bool superChip = false;// the SUPER-CHIP instructions, with 0nnn decoded on its whole low byte rather than the low nibble
+	static const bool xoChip = false;// the XO-CHIP instructions, 64 KB of memory and a second bitplane
+};
+
+struct VipQuirks
+{
+	static const bool shiftVy = true;
+	static const bool resetVf = true;
+	static const bool jumpVx = false;
+	static const bool wrapSprites = false;
+	static const IndexIncrement indexIncrement = IndexIncrement::XPlusOne;
+	static const bool superChip = false;
+	static const bool xoChip = false;
+};
+
+struct Chip48Quirks
+{
+	static const bool shiftVy = false;
+	static const bool resetVf = false;
+	static const bool jumpVx = true;
+	static const bool wrapSprites = false;
+	static const IndexIncrement indexIncrement = IndexIncrement::X;
+	static const bool superChip = false;
+	static const bool xoChip = false;
+};
+
+struct SchipQuirks
+{
+	static const bool shiftVy = false;
+	static const bool resetVf = false;
+	static const bool jumpVx = true;
+	static const bool wrapSprites = false;
+	static const IndexIncrement indexIncrement = IndexIncrement::None;
+	static const bool superChip = true;
+	static const bool xoChip = false;
+};
+
+struct XoChipQuirks
+{
+	static const bool shiftVy = true;
+	static const bool resetVf = false;
+	static const bool jumpVx = false;
+	static const bool wrapSprites = true;
+	static const IndexIncrement indexIncrement = IndexIncrement::XPlusOne;
+	static const bool superChip = true;
+	static const bool xoChip = true;
+};
+
+// The quirks of a profile as plain values, for code that picks them at run
+// time rather than compile time: the JIT and tools
+struct QuirkFlags
+{
+	bool shiftVy;
+	bool resetVf;
+	bool jumpVx;
+	bool wrapSprites;
+	IndexIncrement indexIncrement;
+	bool superChip;
+	bool xoChip;
+};
+
+QuirkFlags GetQuirkFlags(QuirkProfile profile);
+
+// "default", "vip", "chip48", "schip" or "xochip"; false for anything else
+bool ParseQuirkProfile(char const* name, QuirkProfile& profile);
+char const* QuirkProfileName(QuirkProfile profile);
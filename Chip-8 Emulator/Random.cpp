@@ -0,0 +1,80 @@
+#include "Random.hpp"
+#include <cstring>
+
+namespace
+{
+	// SplitMix64 finalizer: spreads nearby seeds (0, 1, 2... for batch lanes) across the whole state
+	uint64_t Mix(uint64_t x)
+	{
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+}
+
+void RandomByte::Seed(RandomSource source, uint64_t seed)
+{
+	switch (source)
+	{
+		case RandomSource::Pcg:
+			// pcg32_srandom: advance once from zero, add the seed, advance again
+			this->source = source;
+			state = 0;
+			Next();
+			state += seed;
+			Next();
+			break;
+
+		case RandomSource::Xorshift:
+			Restore(source, Mix(seed));
+			break;
+
+		default:
+			// std::minstd_rand0's seeding, so the old sequences come back
+			Restore(source, seed % 2147483647u);
+			break;
+	}
+}
+
+void RandomByte::Restore(RandomSource source, uint64_t state)
+{
+	this->source = source;
+	this->state = state;
+
+	// Xorshift sticks at zero and MinStd at zero or a multiple of its modulus
+	if (source == RandomSource::Xorshift && state == 0)
+	{
+		this->state = 0x853C49E6748FEA9Bull;
+	}
+	else if (source == RandomSource::MinStd)
+	{
+		this->state = state % 2147483647u;
+		if (this->state == 0)
+		{
+			this->state = 1;
+		}
+	}
+}
+
+bool ParseRandomSource(char const* name, RandomSource& source)
+{
+	if (strcmp(name, "pcg") == 0)
+	{
+		source = RandomSource::Pcg;
+	}
+	else if (strcmp(name, "xorshift") == 0)
+	{
+		source = RandomSource::Xorshift;
+	}
+	else if (strcmp(name, "minstd") == 0)
+	{
+		source = RandomSource::MinStd;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+// Generators Cxkk can draw from, chosen per machine
+enum class RandomSource
+{
+	Pcg,// PCG32 (XSH RR), the default
+	Xorshift,// xorshift64*
+	MinStd// Park-Miller scaled to a byte the way libstdc++'s uniform_int_distribution
+	      // does, which reproduces seeded runs from before the others existed
+};
+
+// Random bytes from the selected generator. Every variant is fixed-width integer
+// arithmetic, so a seed gives the same sequence on every platform and standard
+// library, and the whole generator is one word of state for snapshots.
+class RandomByte
+{
+public:
+	void Seed(RandomSource source, uint64_t seed);
+	// Restores a generator saved as Source() and State()
+	void Restore(RandomSource source, uint64_t state);
+
+	uint8_t Next()
+	{
+		switch (source)
+		{
+			case RandomSource::Pcg:
+			{
+				uint64_t old = state;
+				state = old * 6364136223846793005ull + PCG_INCREMENT;
+
+				uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+				uint32_t rotation = static_cast<uint32_t>(old >> 59);
+				uint32_t output = (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+
+				// The high bits are the strongest
+				return static_cast<uint8_t>(output >> 24);
+			}
+
+			case RandomSource::Xorshift:
+				state ^= state >> 12;
+				state ^= state << 25;
+				state ^= state >> 27;
+				return static_cast<uint8_t>((state * 0x2545F4914F6CDD1Dull) >> 56);
+
+			default:
+			{
+				// Reject the top of the range so all 256 values are equally likely
+				uint64_t value;
+				do
+				{
+					state = state * 16807 % 2147483647;
+					value = state - 1;
+				} while (value >= MINSTD_SCALE * 256);
+
+				return static_cast<uint8_t>(value / MINSTD_SCALE);
+			}
+		}
+	}
+
+	RandomSource Source() const { return source; }
+	uint64_t State() const { return state; }
+
+private:
+	static const uint64_t PCG_INCREMENT = 1442695040888963407ull;
+	static const uint64_t MINSTD_SCALE = 2147483645 / 256;
+
+	RandomSource source{RandomSource::Pcg};
+	uint64_t state{};
+};
+
+// Parses "pcg", "xorshift" or "minstd"; false for anything else
+bool ParseRandomSource(char const* name, RandomSource& source);
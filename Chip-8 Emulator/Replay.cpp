@@ -0,0 +1,400 @@
+#include "Replay.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+namespace
+{
+	const uint32_t RECORDING_MAGIC = 0x50523843;// "C8RP" in little-endian byte order
+	const uint32_t RECORDING_VERSION = 6;
+
+	// Bytes of MachineState ahead of memory, hashed per frame
+	const size_t HASHED_BYTES = offsetof(MachineState, memory);
+
+	template <typename T>
+	void Put(std::vector<uint8_t>& out, T value)
+	{
+		uint8_t bytes[sizeof(T)];
+		memcpy(bytes, &value, sizeof(T));
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	template <typename T>
+	bool Get(uint8_t const*& in, uint8_t const* end, T& value)
+	{
+		if (size_t(end - in) < sizeof(T))
+		{
+			return false;
+		}
+
+		memcpy(&value, in, sizeof(T));
+		in += sizeof(T);
+		return true;
+	}
+
+	void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	bool GetVarint(uint8_t const*& in, uint8_t const* end, uint64_t& value)
+	{
+		value = 0;
+
+		for (unsigned int shift = 0; shift < 64 && in < end; shift += 7)
+		{
+			uint8_t byte = *in++;
+			value |= uint64_t(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+bool SaveRecording(Recording const& recording, char const* filename)
+{
+	std::vector<uint8_t> out;
+
+	Put(out, RECORDING_MAGIC);
+	Put(out, RECORDING_VERSION);
+	Put(out, recording.seed);
+	Put(out, recording.clockHz);
+	Put(out, static_cast<uint32_t>(recording.randomSource));
+	Put(out, static_cast<uint32_t>(recording.quirks));
+	Put(out, recording.romHash);
+	Put(out, recording.endCycle);
+	Put(out, uint64_t(recording.keys.size()));
+	Put(out, uint64_t(recording.frameHashes.size()));
+
+	uint64_t cycle = 0;
+
+	for (Recording::KeyChange const& change : recording.keys)
+	{
+		PutVarint(out, change.cycle - cycle);
+		out.push_back(static_cast<uint8_t>(change.key | (change.down << 7)));
+		cycle = change.cycle;
+	}
+
+	for (uint64_t hash : recording.frameHashes)
+	{
+		Put(out, hash);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(reinterpret_cast<char const*>(out.data()), out.size());
+
+	return bool(file);
+}
+
+bool LoadRecording(Recording& recording, char const* filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	uint8_t const* in = data.data();
+	uint8_t const* end = in + data.size();
+
+	uint32_t magic, version, source, quirks;
+	uint64_t keyCount, frameCount;
+
+	// Frame hashes cover the whole MachineState ahead of memory, so older versions can't be checked
+	if (!Get(in, end, magic) || !Get(in, end, version) || magic != RECORDING_MAGIC || version != RECORDING_VERSION
+		|| !Get(in, end, recording.seed) || !Get(in, end, recording.clockHz) || !Get(in, end, source)
+		|| source > static_cast<uint32_t>(RandomSource::MinStd) || !Get(in, end, quirks)
+		|| quirks > static_cast<uint32_t>(QuirkProfile::XoChip))
+	{
+		return false;
+	}
+
+	recording.randomSource = static_cast<RandomSource>(source);
+	recording.quirks = static_cast<QuirkProfile>(quirks);
+
+	if (!Get(in, end, recording.romHash) || !Get(in, end, recording.endCycle) || !Get(in, end, keyCount) || !Get(in, end, frameCount))
+	{
+		return false;
+	}
+
+	// Each key change is at least two bytes and each hash eight, which bounds the counts before allocating
+	if (keyCount > size_t(end - in) / 2 || frameCount > size_t(end - in) / sizeof(uint64_t))
+	{
+		return false;
+	}
+
+	recording.keys.clear();
+	recording.frameHashes.clear();
+
+	uint64_t cycle = 0;
+
+	for (uint64_t i = 0; i < keyCount; ++i)
+	{
+		uint64_t delta;
+		uint8_t packed;
+
+		if (!GetVarint(in, end, delta) || !Get(in, end, packed))
+		{
+			return false;
+		}
+
+		cycle += delta;
+		recording.keys.push_back(Recording::KeyChange{ cycle, static_cast<uint8_t>(packed & 0x0F), static_cast<uint8_t>(packed >> 7) });
+	}
+
+	for (uint64_t i = 0; i < frameCount; ++i)
+	{
+		uint64_t hash;
+
+		if (!Get(in, end, hash))
+		{
+			return false;
+		}
+
+		recording.frameHashes.push_back(hash);
+	}
+
+	return true;
+}
+
+uint64_t HashROM(char const* filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return 0;
+	}
+
+	uint64_t hash = 0xCBF29CE484222325ull;
+	char byte;
+
+	while (file.get(byte))
+	{
+		hash = (hash ^ static_cast<uint8_t>(byte)) * 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+uint64_t HashState(MachineState const& state)
+{
+	uint64_t words[HASHED_BYTES / sizeof(uint64_t)];
+	memcpy(words, &state, sizeof(words));
+
+	return HashFrame(words, static_cast<int>(HASHED_BYTES / sizeof(uint64_t)));
+}
+
+std::string DescribeDifference(MachineState const& a, MachineState const& b)
+{
+	std::ostringstream out;
+	out << std::hex << std::setfill('0');
+
+	auto field = [&](char const* name, int index, unsigned long long x, unsigned long long y, int width)
+	{
+		out << name;
+		if (index >= 0)
+		{
+			out << "[" << index << "]";
+		}
+		out << " " << std::setw(width) << x << " != " << std::setw(width) << y;
+	};
+
+	if (a.scheduler.elapsed != b.scheduler.elapsed) field("cycles", -1, a.scheduler.elapsed, b.scheduler.elapsed, 1);
+	else if (a.pc != b.pc) field("pc", -1, a.pc, b.pc, 4);
+	else if (a.index != b.index) field("i", -1, a.index, b.index, 4);
+	else if (a.sp != b.sp) field("sp", -1, a.sp, b.sp, 2);
+	else if (a.delayTimer != b.delayTimer) field("dt", -1, a.delayTimer, b.delayTimer, 2);
+	else if (a.soundTimer != b.soundTimer) field("st", -1, a.soundTimer, b.soundTimer, 2);
+	else if (a.rngSource != b.rngSource) field("rng source", -1, a.rngSource, b.rngSource, 1);
+	else if (a.rngState != b.rngState) field("rng", -1, a.rngState, b.rngState, 16);
+	else if (a.quirks != b.quirks) field("quirks", -1, a.quirks, b.quirks, 1);
+	else if (a.hires != b.hires) field("hires", -1, a.hires, b.hires, 1);
+	else if (a.planes != b.planes) field("planes", -1, a.planes, b.planes, 1);
+	else if (a.pitch != b.pitch) field("pitch", -1, a.pitch, b.pitch, 2);
+	else
+	{
+		for (unsigned int i = 0; i < REGISTER_COUNT && out.tellp() == 0; ++i)
+		{
+			if (a.registers[i] != b.registers[i]) field("v", i, a.registers[i], b.registers[i], 2);
+		}
+		for (unsigned int i = 0; i < STACK_LEVELS && out.tellp() == 0; ++i)
+		{
+			if (a.stack[i] != b.stack[i]) field("stack", i, a.stack[i], b.stack[i], 4);
+		}
+		for (unsigned int i = 0; i < KEY_COUNT && out.tellp() == 0; ++i)
+		{
+			if (a.keypad[i] != b.keypad[i]) field("key", i, a.keypad[i], b.keypad[i], 1);
+		}
+		for (unsigned int i = 0; i < RPL_FLAG_COUNT && out.tellp() == 0; ++i)
+		{
+			if (a.rplFlags[i] != b.rplFlags[i]) field("rpl", i, a.rplFlags[i], b.rplFlags[i], 2);
+		}
+		for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE && out.tellp() == 0; ++i)
+		{
+			if (a.audioPattern[i] != b.audioPattern[i]) field("pattern", i, a.audioPattern[i], b.audioPattern[i], 2);
+		}
+		for (unsigned int plane = 0; plane < PLANE_COUNT && out.tellp() == 0; ++plane)
+		{
+			for (unsigned int i = 0; i < VIDEO_WORDS && out.tellp() == 0; ++i)
+			{
+				if (a.video[plane][i] != b.video[plane][i])
+				{
+					out << "plane " << plane << " ";
+					field("video word", i, a.video[plane][i], b.video[plane][i], 16);
+				}
+			}
+		}
+		size_t memorySize = std::min(MachineStateSize(a), MachineStateSize(b)) - offsetof(MachineState, memory);
+		for (size_t i = 0; i < memorySize && out.tellp() == 0; ++i)
+		{
+			if (a.memory[i] != b.memory[i]) field("memory", i, a.memory[i], b.memory[i], 2);
+		}
+	}
+
+	return out.str();
+}
+
+bool Recorder::Start(Chip8 const& chip8, char const* romFilename)
+{
+	recording = Recording();
+	recording.seed = chip8.Seed();
+	recording.randomSource = chip8.GetRandomSource();
+	recording.quirks = chip8.GetQuirks();
+	recording.clockHz = chip8.GetScheduler().ClockHz();
+	recording.romHash = HashROM(romFilename);
+	recording.endCycle = chip8.GetScheduler().Cycles();
+	memset(keys, 0, sizeof(keys));
+
+	return recording.romHash != 0;
+}
+
+void Recorder::CaptureKeys(Chip8 const& chip8)
+{
+	uint64_t cycle = chip8.GetScheduler().Cycles();
+
+	for (unsigned int key = 0; key < KEY_COUNT; ++key)
+	{
+		uint8_t down = chip8.keypad[key] ? 1 : 0;
+
+		if (down != keys[key])
+		{
+			recording.keys.push_back(Recording::KeyChange{ cycle, static_cast<uint8_t>(key), down });
+			keys[key] = down;
+		}
+	}
+}
+
+void Recorder::EndFrame(Chip8 const& chip8)
+{
+	chip8.Save(scratch);
+
+	recording.frameHashes.push_back(HashState(scratch));
+	recording.endCycle = chip8.GetScheduler().Cycles();
+}
+
+void Recorder::Truncate(Chip8 const& chip8)
+{
+	Scheduler const& scheduler = chip8.GetScheduler();
+
+	// Changes stamped at the restored cycle were captured after that state was saved
+	auto firstDropped = std::find_if(recording.keys.begin(), recording.keys.end(),
+		[&](Recording::KeyChange const& change) { return change.cycle >= scheduler.Cycles(); });
+	recording.keys.erase(firstDropped, recording.keys.end());
+
+	if (recording.frameHashes.size() > scheduler.Ticks())
+	{
+		recording.frameHashes.resize(scheduler.Ticks());
+	}
+
+	recording.endCycle = scheduler.Cycles();
+
+	memset(keys, 0, sizeof(keys));
+	for (Recording::KeyChange const& change : recording.keys)
+	{
+		keys[change.key] = change.down;
+	}
+}
+
+bool Recorder::Save(char const* filename)
+{
+	return SaveRecording(recording, filename);
+}
+
+void Replayer::Start(Chip8& chip8)
+{
+	chip8.SetRandom(recording.randomSource, recording.seed);
+	chip8.SetQuirks(recording.quirks);
+	chip8.SetClockHz(recording.clockHz);
+}
+
+void Replayer::Run(Chip8& chip8, uint64_t cycle)
+{
+	Scheduler const& scheduler = chip8.GetScheduler();
+	uint64_t target = std::min(cycle, recording.endCycle);
+
+	while (scheduler.Cycles() < target)
+	{
+		while (nextKey < recording.keys.size() && recording.keys[nextKey].cycle <= scheduler.Cycles())
+		{
+			chip8.keypad[recording.keys[nextKey].key] = recording.keys[nextKey].down;
+			++nextKey;
+		}
+
+		// Stop at the next key change or frame end, whichever comes first
+		uint64_t budget = std::min<uint64_t>(target - scheduler.Cycles(), scheduler.CyclesUntilTick());
+		if (nextKey < recording.keys.size())
+		{
+			budget = std::min(budget, recording.keys[nextKey].cycle - scheduler.Cycles());
+		}
+
+		uint64_t ticks = scheduler.Ticks();
+
+		chip8.RunCycles(static_cast<unsigned int>(budget));
+
+		if (scheduler.Ticks() != ticks)
+		{
+			CheckFrame(chip8);
+		}
+	}
+}
+
+void Replayer::CheckFrame(Chip8 const& chip8)
+{
+	uint64_t cycle = chip8.GetScheduler().Cycles();
+
+	// Once diverged every later frame differs too, so stop paying for the hashes
+	if (!diverged && framesChecked < recording.frameHashes.size())
+	{
+		chip8.Save(scratch);
+
+		if (HashState(scratch) != recording.frameHashes[framesChecked])
+		{
+			diverged = true;
+			firstMismatchFrame = framesChecked;
+			firstMismatchStart = frameStart;
+			firstMismatchEnd = cycle;
+		}
+	}
+
+	++framesChecked;
+	frameStart = cycle;
+}
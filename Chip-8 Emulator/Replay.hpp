@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Chip8.hpp"
+
+// Everything needed to re-run a session bit for bit: the RNG and its seed, the quirks, the clock,
+// which ROM, and every keypad change stamped with the cycle it took effect at.
+// A hash of the machine state at the end of every frame lets a replay check
+// itself against the original run.
+struct Recording
+{
+	struct KeyChange
+	{
+		uint64_t cycle;// applied before the instruction at this cycle count
+		uint8_t key;
+		uint8_t down;
+	};
+
+	uint64_t seed{};
+	RandomSource randomSource{RandomSource::Pcg};
+	QuirkProfile quirks{QuirkProfile::Default};
+	uint32_t clockHz{DEFAULT_CLOCK_HZ};
+	uint64_t romHash{};
+	uint64_t endCycle{};
+	std::vector<KeyChange> keys;
+	std::vector<uint64_t> frameHashes;// state at the end of frame f, i.e. at timer tick f + 1
+};
+
+// File format, host byte order (little-endian on every target this builds for):
+// a fixed header of magic, version, seed, clock, RNG, quirks, ROM hash, end cycle and
+// counts, then each key change as a varint cycle delta and one byte
+// (key | down << 7), then one 64-bit hash per frame
+bool SaveRecording(Recording const& recording, char const* filename);
+bool LoadRecording(Recording& recording, char const* filename);
+
+// FNV-1a hash of a ROM file, so a replay can tell it has the right one
+uint64_t HashROM(char const* filename);
+// Hash of everything in the machine except memory, which only changes through
+// Fx33/Fx55 and shows up in the registers soon after
+uint64_t HashState(MachineState const& state);
+// Names the first field two states differ in, with both values; empty if they match
+std::string DescribeDifference(MachineState const& a, MachineState const& b);
+
+// Builds a Recording from a live session
+class Recorder
+{
+public:
+	// Starts recording chip8, freshly loaded with romFilename and not yet run
+	bool Start(Chip8 const& chip8, char const* romFilename);
+	// Stamps the keypad changes since the last call with the current cycle
+	void CaptureKeys(Chip8 const& chip8);
+	// Records the state at the end of a frame
+	void EndFrame(Chip8 const& chip8);
+	// Forgets everything after chip8's current cycle, after it was rewound
+	void Truncate(Chip8 const& chip8);
+	bool Save(char const* filename);
+
+	Recording const& GetRecording() const { return recording; }
+
+private:
+	Recording recording;
+	uint8_t keys[KEY_COUNT]{};// keypad as of the last recorded change
+	MachineState scratch;
+};
+
+// Drives a machine through a Recording, checking every frame against it
+class Replayer
+{
+public:
+	explicit Replayer(Recording const& recording) : recording(recording) {}
+
+	// Seeds, configures and clocks a machine freshly loaded with the recorded ROM
+	void Start(Chip8& chip8);
+	// Runs until the machine's clock reaches cycle or the recording ends, applying key
+	// changes at their cycles and checking the state at every frame end
+	void Run(Chip8& chip8, uint64_t cycle);
+	bool Finished(Chip8 const& chip8) const { return chip8.GetScheduler().Cycles() >= recording.endCycle; }
+
+	uint64_t FramesChecked() const { return framesChecked; }
+	// First frame whose state did not match the recording, if any, with the
+	// cycle range it covers; the state matched at firstMismatchStart
+	bool Diverged() const { return diverged; }
+	uint64_t FirstMismatchFrame() const { return firstMismatchFrame; }
+	uint64_t FirstMismatchStart() const { return firstMismatchStart; }
+	uint64_t FirstMismatchEnd() const { return firstMismatchEnd; }
+
+private:
+	void CheckFrame(Chip8 const& chip8);
+
+	Recording const& recording;
+	size_t nextKey{};
+	uint64_t frameStart{};
+	uint64_t framesChecked{};
+	bool diverged{};
+	uint64_t firstMismatchFrame{};
+	uint64_t firstMismatchStart{};
+	uint64_t firstMismatchEnd{};
+	MachineState scratch;
+};
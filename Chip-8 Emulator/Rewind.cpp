@@ -0,0 +1,287 @@
+#include "Rewind.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Smallest ring that still holds a few keyframes and their deltas
+	const size_t MIN_BUDGET = 4 * sizeof(MachineState);
+
+	// Zero runs shorter than this stay inside a literal, where they cost less than a new token
+	const size_t MIN_ZERO_RUN = 3;
+
+	void PutVarint(std::vector<uint8_t>& out, size_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	size_t GetVarint(uint8_t const*& in)
+	{
+		size_t value = 0;
+
+		for (unsigned int shift = 0;; shift += 7)
+		{
+			uint8_t byte = *in++;
+			value |= size_t(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80))
+			{
+				return value;
+			}
+		}
+	}
+
+	inline uint8_t XorByte(uint8_t const* state, uint8_t const* base, size_t i)
+	{
+		return base ? state[i] ^ base[i] : state[i];
+	}
+
+	// Length of the run of zero bytes in state ^ base starting at i, eight bytes at a time where it can
+	size_t ZeroRun(uint8_t const* state, uint8_t const* base, size_t i, size_t size)
+	{
+		size_t start = i;
+
+		while (i + 8 <= size)
+		{
+			uint64_t a, b = 0;
+			memcpy(&a, state + i, sizeof(a));
+			if (base)
+			{
+				memcpy(&b, base + i, sizeof(b));
+			}
+
+			if (a != b)
+			{
+				break;
+			}
+
+			i += 8;
+		}
+
+		while (i < size && XorByte(state, base, i) == 0)
+		{
+			++i;
+		}
+
+		return i - start;
+	}
+
+	// Encodes state ^ base (base null meaning all zero) as pairs of a zero run
+	// length and a literal, both lengths as varints, the literal as XOR bytes
+	void Encode(uint8_t const* state, uint8_t const* base, size_t size, std::vector<uint8_t>& out)
+	{
+		out.clear();
+
+		size_t i = 0;
+
+		while (i < size)
+		{
+			size_t zeros = ZeroRun(state, base, i, size);
+			i += zeros;
+
+			size_t literalStart = i;
+
+			while (i < size)
+			{
+				size_t gap = ZeroRun(state, base, i, std::min(size, i + MIN_ZERO_RUN));
+
+				if (gap == MIN_ZERO_RUN || i + gap == size)
+				{
+					break;
+				}
+
+				i += gap + 1;
+			}
+
+			PutVarint(out, zeros);
+			PutVarint(out, i - literalStart);
+
+			for (size_t j = literalStart; j < i; ++j)
+			{
+				out.push_back(XorByte(state, base, j));
+			}
+		}
+	}
+
+	void Decode(uint8_t const* in, uint8_t const* end, uint8_t* state)
+	{
+		size_t i = 0;
+
+		while (in < end)
+		{
+			i += GetVarint(in);
+			size_t literal = GetVarint(in);
+
+			for (size_t j = 0; j < literal; ++j)
+			{
+				state[i++] ^= *in++;
+			}
+		}
+	}
+}
+
+RewindBuffer::RewindBuffer(size_t budgetBytes, unsigned int keyframeInterval)
+	: ring(std::max(budgetBytes, MIN_BUDGET)), keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1)
+{
+	scratch.reserve(2 * sizeof(MachineState));
+}
+
+void RewindBuffer::Clear()
+{
+	entries.clear();
+	used = 0;
+	sinceKeyframe = 0;
+}
+
+void RewindBuffer::Push(Chip8 const& chip8)
+{
+	chip8.Save(scratchState);
+
+	uint8_t const* state = reinterpret_cast<uint8_t const*>(&scratchState);
+	uint8_t const* previous = reinterpret_cast<uint8_t const*>(&newest);
+
+	// Only the bytes the state's profile uses; a change of profile starts from a keyframe,
+	// so a delta never spans memory one of its two frames left out
+	size_t size = MachineStateSize(scratchState);
+	bool keyframe = entries.empty() || sinceKeyframe >= keyframeInterval || size != MachineStateSize(newest);
+	Encode(state, keyframe ? nullptr : previous, size, scratch);
+
+	while (!entries.empty() && BytesUsed() + scratch.size() + sizeof(Entry) > ring.size())
+	{
+		EvictOldest();
+	}
+
+	// The frame this delta was against is gone along with everything else
+	if (entries.empty() && !keyframe)
+	{
+		keyframe = true;
+		Encode(state, nullptr, size, scratch);
+	}
+
+	if (Append(keyframe))
+	{
+		newest = scratchState;
+	}
+}
+
+bool RewindBuffer::Append(bool keyframe)
+{
+	// Only a frame that could never be stored: the history has already been evicted
+	// to make room, and the next Push starts again from a keyframe
+	if (scratch.size() + sizeof(Entry) > ring.size())
+	{
+		return false;
+	}
+
+	Entry entry;
+	entry.offset = static_cast<uint32_t>(entries.empty() ? 0 : (entries.back().offset + entries.back().size) % ring.size());
+	entry.size = static_cast<uint32_t>(scratch.size());
+	entry.keyframe = keyframe ? 1 : 0;
+
+	// Copy in, wrapping around the end of the ring
+	size_t first = std::min(scratch.size(), ring.size() - entry.offset);
+	memcpy(&ring[entry.offset], scratch.data(), first);
+	memcpy(&ring[0], scratch.data() + first, scratch.size() - first);
+
+	entries.push_back(entry);
+	used += entry.size;
+	sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+	return true;
+}
+
+// Drops the oldest keyframe with the deltas that depend on it
+void RewindBuffer::EvictOldest()
+{
+	do
+	{
+		used -= entries.front().size;
+		entries.pop_front();
+	} while (!entries.empty() && !entries.front().keyframe);
+}
+
+void RewindBuffer::Apply(Entry const& entry, MachineState& state)
+{
+	scratch.resize(entry.size);
+
+	size_t first = std::min<size_t>(entry.size, ring.size() - entry.offset);
+	memcpy(scratch.data(), &ring[entry.offset], first);
+	memcpy(scratch.data() + first, &ring[0], entry.size - first);
+
+	Decode(scratch.data(), scratch.data() + scratch.size(), reinterpret_cast<uint8_t*>(&state));
+}
+
+void RewindBuffer::Rebuild(size_t position, MachineState& state)
+{
+	size_t keyframe = position;
+
+	while (!entries[keyframe].keyframe)
+	{
+		--keyframe;
+	}
+
+	memset(&state, 0, sizeof(state));
+
+	for (size_t i = keyframe; i <= position; ++i)
+	{
+		Apply(entries[i], state);
+	}
+}
+
+bool RewindBuffer::StepBack(Chip8& chip8)
+{
+	if (entries.size() < 2)
+	{
+		return false;
+	}
+
+	Entry last = entries.back();
+
+	// A delta undoes itself; the frame before a keyframe has to be rebuilt from the keyframe before that
+	if (!last.keyframe)
+	{
+		Apply(last, newest);
+	}
+
+	entries.pop_back();
+	used -= last.size;
+
+	if (last.keyframe)
+	{
+		Rebuild(entries.size() - 1, newest);
+	}
+
+	sinceKeyframe = 0;
+	for (size_t i = entries.size(); i-- > 0;)
+	{
+		++sinceKeyframe;
+
+		if (entries[i].keyframe)
+		{
+			break;
+		}
+	}
+
+	return chip8.Load(newest);
+}
+
+double RewindBuffer::BytesPerMinute() const
+{
+	if (entries.empty())
+	{
+		return 0.0;
+	}
+
+	return double(BytesUsed()) / entries.size() * TIMER_HZ * 60;
+}
+
+void RewindBuffer::Report(std::ostream& out) const
+{
+	out << "rewind " << entries.size() << " frames (" << double(entries.size()) / TIMER_HZ << " s), " << BytesUsed() / 1024.0 << " KB of "
+		<< Budget() / 1024.0 << " KB, " << BytesPerMinute() / 1024.0 << " KB per minute\n";
+}
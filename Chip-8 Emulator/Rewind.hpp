@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <vector>
+#include "Chip8.hpp"
+
+// History of machine states, one per frame, for stepping a session backwards.
+//
+// Every frame is stored as the XOR of its MachineState with the previous frame's,
+// run-length encoded: consecutive frames differ in a few registers, timers, video
+// rows and memory bytes, so most of the XOR is zero runs. Every keyframeInterval
+// frames the state is stored whole (encoded against zero) so any frame can be
+// rebuilt from one keyframe plus the deltas after it. The encoded frames live in
+// one fixed byte ring; when the ring and the per-frame bookkeeping reach the
+// budget, the oldest keyframe and its deltas go.
+class RewindBuffer
+{
+public:
+	explicit RewindBuffer(size_t budgetBytes, unsigned int keyframeInterval = TIMER_HZ);
+
+	// Records the machine's state as the newest frame
+	void Push(Chip8 const& chip8);
+	// Drops the newest frame and loads the one before it; false once there is nothing earlier
+	bool StepBack(Chip8& chip8);
+	void Clear();
+
+	size_t Frames() const { return entries.size(); }
+	// Ring bytes in use plus the per-frame bookkeeping
+	size_t BytesUsed() const { return used + entries.size() * sizeof(Entry); }
+	size_t Budget() const { return ring.size(); }
+	// Bytes one minute of 60 Hz history takes at the current average frame size
+	double BytesPerMinute() const;
+	void Report(std::ostream& out) const;
+
+private:
+	struct Entry
+	{
+		uint32_t offset;// into ring, wrapping at the end
+		uint32_t size : 31;
+		uint32_t keyframe : 1;
+	};
+
+	// Stores scratch as the newest frame; false if it is larger than the whole ring
+	bool Append(bool keyframe);
+	void EvictOldest();
+	// XORs the encoded frame into state
+	void Apply(Entry const& entry, MachineState& state);
+	// Rebuilds entries[position] into state from the keyframe at or before it
+	void Rebuild(size_t position, MachineState& state);
+
+	std::vector<uint8_t> ring;
+	size_t used{};
+	std::deque<Entry> entries;
+	unsigned int keyframeInterval;
+	unsigned int sinceKeyframe{};
+
+	MachineState newest{};// state of entries.back()
+	MachineState scratchState{};
+	std::vector<uint8_t> scratch;// one frame's encoding
+};
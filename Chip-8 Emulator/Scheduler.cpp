@@ -0,0 +1,65 @@
+#include "Scheduler.hpp"
+
+Scheduler::Scheduler(uint32_t clockHz)
+	: clockHz(clockHz > 0 ? clockHz : 1)
+{
+	ScheduleNextTick();
+}
+
+void Scheduler::SetClockHz(uint32_t clockHz)
+{
+	clockHz = clockHz > 0 ? clockHz : 1;
+
+	if (clockHz == this->clockHz)
+	{
+		return;
+	}
+
+	this->clockHz = clockHz;
+	baseCycles = elapsed;
+	baseTicks = ticks;
+
+	ScheduleNextTick();
+}
+
+uint64_t Scheduler::Nanoseconds() const
+{
+	// Split to stay exact without overflowing for very long runs
+	return (elapsed / clockHz) * 1000000000ull + (elapsed % clockHz) * 1000000000ull / clockHz;
+}
+
+SchedulerState Scheduler::GetState() const
+{
+	return SchedulerState{ elapsed, ticks, nextTick, baseCycles, baseTicks, clockHz, 0 };
+}
+
+void Scheduler::SetState(SchedulerState const& state)
+{
+	elapsed = state.elapsed;
+	ticks = state.ticks;
+	nextTick = state.nextTick;
+	baseCycles = state.baseCycles;
+	baseTicks = state.baseTicks;
+	clockHz = state.clockHz > 0 ? state.clockHz : 1;
+}
+
+unsigned int Scheduler::CollectTicks()
+{
+	unsigned int due = 0;
+
+	while (elapsed >= nextTick)
+	{
+		++ticks;
+		++due;
+		ScheduleNextTick();
+	}
+
+	return due;
+}
+
+void Scheduler::ScheduleNextTick()
+{
+	uint64_t ticksSinceBase = ticks - baseTicks + 1;
+
+	nextTick = baseCycles + (ticksSinceBase * clockHz + TIMER_HZ - 1) / TIMER_HZ;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+const uint32_t DEFAULT_CLOCK_HZ = 600;
+const uint32_t TIMER_HZ = 60;
+
+// Everything a Scheduler tracks, laid out without padding for machine snapshots
+struct SchedulerState
+{
+	uint64_t elapsed;
+	uint64_t ticks;
+	uint64_t nextTick;
+	uint64_t baseCycles;
+	uint64_t baseTicks;
+	uint32_t clockHz;
+	uint32_t reserved;
+};
+
+// Emulated clock of the CPU. Cycles are counted from power-on and the 60 Hz
+// delay/sound timer ticks fall due on exact cycle boundaries derived from the
+// clock rate, so timer speed does not depend on how fast the host runs the
+// instructions. Tick k is due once cycle ceil(k * clockHz / 60) has elapsed.
+class Scheduler
+{
+public:
+	explicit Scheduler(uint32_t clockHz = DEFAULT_CLOCK_HZ);
+
+	// Changing the rate keeps the ticks already due and re-derives the rest from now
+	void SetClockHz(uint32_t clockHz);
+	uint32_t ClockHz() const { return clockHz; }
+
+	// Advances the clock by cycles and returns how many timer ticks fell due
+	unsigned int Advance(unsigned int cycles)
+	{
+		elapsed += cycles;
+		return elapsed >= nextTick ? CollectTicks() : 0;
+	}
+
+	// Cycles that can run before the next timer tick falls due
+	unsigned int CyclesUntilTick() const { return static_cast<unsigned int>(nextTick - elapsed); }
+
+	// Emulated clock, for tracing
+	uint64_t Cycles() const { return elapsed; }
+	uint64_t Ticks() const { return ticks; }
+	uint64_t Nanoseconds() const;
+
+	SchedulerState GetState() const;
+	void SetState(SchedulerState const& state);
+
+private:
+	unsigned int CollectTicks();
+	void ScheduleNextTick();
+
+	uint32_t clockHz;
+	uint64_t elapsed{};
+	uint64_t ticks{};
+	uint64_t nextTick{};// cycle count at which the next tick is due
+
+	// Reference point the tick schedule is derived from, moved on a rate change
+	uint64_t baseCycles{};
+	uint64_t baseTicks{};
+};
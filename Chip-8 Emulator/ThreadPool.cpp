@@ -0,0 +1,136 @@
+#include "ThreadPool.hpp"
+
+namespace
+{
+	// Which pool and worker the calling thread belongs to, if any
+	thread_local ThreadPool* currentPool = nullptr;
+	thread_local unsigned int currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(new Worker);
+	}
+
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	unsigned int id = currentPool == this ? currentWorker : nextWorker++ % Size();
+
+	++pending;
+
+	{
+		std::lock_guard<std::mutex> lock(workers[id]->mutex);
+		workers[id]->tasks.push_back(std::move(task));
+	}
+
+	// Counted before taking the sleep lock, so a worker about to sleep either sees
+	// the task or gets the notification
+	++queued;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	done.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::WorkerLoop(unsigned int id)
+{
+	currentPool = this;
+	currentWorker = id;
+
+	std::function<void()> task;
+
+	for (;;)
+	{
+		if (TryPop(id, task) || TrySteal(id, task))
+		{
+			--queued;
+			task();
+			task = nullptr;
+
+			if (--pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				done.notify_all();
+			}
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+
+		if (stopping && queued == 0)
+		{
+			return;
+		}
+	}
+}
+
+bool ThreadPool::TryPop(unsigned int id, std::function<void()>& task)
+{
+	Worker& worker = *workers[id];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+
+	if (worker.tasks.empty())
+	{
+		return false;
+	}
+
+	task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+
+	return true;
+}
+
+bool ThreadPool::TrySteal(unsigned int id, std::function<void()>& task)
+{
+	for (unsigned int offset = 1; offset < Size(); ++offset)
+	{
+		Worker& victim = *workers[(id + offset) % Size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			++steals;
+
+			return true;
+		}
+	}
+
+	return false;
+}
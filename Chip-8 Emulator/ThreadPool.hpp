@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. A worker runs its own
+// tasks newest first and, when it runs dry, steals the oldest task of another
+// worker, so long and short jobs balance out without a shared queue.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	// Tasks submitted from a worker go to that worker's deque, others are spread round-robin
+	void Submit(std::function<void()> task);
+	// Blocks until every submitted task, including ones submitted by tasks, has finished
+	void Wait();
+
+	unsigned int Size() const { return static_cast<unsigned int>(workers.size()); }
+	uint64_t Steals() const { return steals; }
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void WorkerLoop(unsigned int id);
+	bool TryPop(unsigned int id, std::function<void()>& task);
+	bool TrySteal(unsigned int id, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;// a task was queued or the pool is stopping
+	std::condition_variable done;// pending reached zero
+
+	std::atomic<size_t> queued{0};// tasks sitting in deques
+	std::atomic<size_t> pending{0};// tasks submitted and not yet finished
+	std::atomic<uint64_t> steals{0};
+	std::atomic<unsigned int> nextWorker{0};
+	bool stopping{};
+};
@@ -0,0 +1,105 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	// How long the writer sleeps when the ring is empty; the ring holds far more than this much tracing
+	const std::chrono::microseconds IDLE_SLEEP(200);
+}
+
+TraceWriter::TraceWriter(size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	ring.resize(size);
+	mask = size - 1;
+}
+
+TraceWriter::~TraceWriter()
+{
+	Close();
+}
+
+bool TraceWriter::Open(char const* filename, uint32_t clockHz)
+{
+	Close();
+
+	file.open(filename, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	TraceHeader header{ TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), clockHz };
+	file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+	head.store(0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+	cachedTail = 0;
+	stalls = 0;
+	failed = false;
+	closing.store(false, std::memory_order_relaxed);
+
+	writer = std::thread(&TraceWriter::WriterLoop, this);
+
+	return true;
+}
+
+bool TraceWriter::Close()
+{
+	if (!writer.joinable())
+	{
+		return !failed;
+	}
+
+	closing.store(true, std::memory_order_release);
+	writer.join();
+
+	file.close();
+	failed = failed || file.fail();
+
+	return !failed;
+}
+
+void TraceWriter::WriterLoop()
+{
+	for (;;)
+	{
+		// Read closing before head, so everything pushed before Close() is seen below
+		bool last = closing.load(std::memory_order_acquire);
+		size_t end = head.load(std::memory_order_acquire);
+		size_t position = tail.load(std::memory_order_relaxed);
+
+		if (position == end)
+		{
+			if (last)
+			{
+				return;
+			}
+
+			std::this_thread::sleep_for(IDLE_SLEEP);
+			continue;
+		}
+
+		// Everything up to head, in at most two pieces where the ring wraps
+		while (position != end)
+		{
+			size_t count = std::min(end - position, ring.size() - (position & mask));
+
+			if (!failed)
+			{
+				file.write(reinterpret_cast<char const*>(&ring[position & mask]), count * sizeof(TraceRecord));
+				failed = file.fail();
+			}
+
+			position += count;
+			tail.store(position, std::memory_order_release);
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+// TraceRecord::changed: the low nibble names the register the instruction wrote,
+// with flags for the instructions that write more than one
+const uint8_t TRACE_REGISTER_MASK = 0x0F;
+const uint8_t TRACE_ALSO_VF = 0x10;// VF changed as well, e.g. the carry of 8xy4
+const uint8_t TRACE_MORE = 0x20;// other registers changed as well, e.g. Fx65
+const uint8_t TRACE_NONE = 0x80;// no register changed
+
+// One executed instruction
+struct TraceRecord
+{
+	uint64_t cycle;// cycle count before the instruction
+	uint16_t pc;// address of the instruction
+	uint16_t opcode;
+	uint16_t index;// I after the instruction
+	uint8_t changed;// register written, see TRACE_*
+	uint8_t value;// its new value
+};
+
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord layout is the trace file format");
+
+const uint32_t TRACE_MAGIC = 0x52543843;// "C8TR" in little-endian byte order
+const uint32_t TRACE_VERSION = 1;
+
+// Trace file header, followed by TraceRecords to the end of the file, host byte order
+struct TraceHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t clockHz;
+};
+
+// Streams TraceRecords to a file without slowing the emulator down to disk speed.
+// The emulator thread pushes records into a single-producer single-consumer ring
+// and a writer thread drains it to the file in large blocks. The ring only
+// blocks the emulator when the writer falls a whole ring behind; those waits
+// are counted so a trace that throttled the run can be recognized.
+class TraceWriter
+{
+public:
+	// capacity is in records and rounded up to a power of two
+	explicit TraceWriter(size_t capacity = 1u << 18);
+	~TraceWriter();
+
+	// Creates the file and starts the writer thread
+	bool Open(char const* filename, uint32_t clockHz);
+	// Writes out everything pushed so far and stops the writer thread; false if a write failed
+	bool Close();
+
+	// Producer side, one thread only
+	void Push(TraceRecord const& record)
+	{
+		size_t position = head.load(std::memory_order_relaxed);
+
+		if (position - cachedTail == ring.size())
+		{
+			cachedTail = tail.load(std::memory_order_acquire);
+
+			while (position - cachedTail == ring.size())
+			{
+				++stalls;
+				std::this_thread::yield();
+				cachedTail = tail.load(std::memory_order_acquire);
+			}
+		}
+
+		ring[position & mask] = record;
+		head.store(position + 1, std::memory_order_release);
+	}
+
+	uint64_t Records() const { return head.load(std::memory_order_relaxed); }
+	// Pushes that had to wait for the writer
+	uint64_t Stalls() const { return stalls; }
+
+private:
+	void WriterLoop();
+
+	std::vector<TraceRecord> ring;
+	size_t mask;
+	std::ofstream file;
+	std::thread writer;
+	std::atomic<bool> closing{false};
+	bool failed{};
+
+	// Producer and consumer indices on their own cache lines so they don't bounce
+	alignas(64) std::atomic<size_t> head{0};
+	size_t cachedTail{};// producer's last view of tail
+	uint64_t stalls{};
+	alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,102 @@
+#include "Trace.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Prints a trace written by TraceWriter as text, one instruction per line:
+// cycle, pc, opcode, I after the instruction and the register it wrote
+int main(int argc, char** argv)
+{
+	char const* traceFilename = nullptr;
+	uint64_t from = 0;// first cycle to print
+	uint64_t count = UINT64_MAX;// records to print
+	bool usage = false;
+
+	for (int i = 1; i < argc && !usage; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--from" && hasValue)
+		{
+			from = std::stoull(argv[++i]);
+		}
+		else if (arg == "--count" && hasValue)
+		{
+			count = std::stoull(argv[++i]);
+		}
+		else if (!traceFilename && arg[0] != '-')
+		{
+			traceFilename = argv[i];
+		}
+		else
+		{
+			usage = true;
+		}
+	}
+
+	if (usage || !traceFilename)
+	{
+		std::cerr << "Usage: " << argv[0] << " <Trace> [--from <Cycle>] [--count <N>]\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	std::ifstream file(traceFilename, std::ios::binary);
+	TraceHeader header;
+
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION
+		|| header.recordSize != sizeof(TraceRecord))
+	{
+		std::cerr << "Cannot read trace " << traceFilename << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+	std::cout << "# clock " << header.clockHz << " Hz\n";
+	std::cout << std::hex << std::setfill('0');
+
+	// Records are read in blocks; a partial record at the end, from a run that was killed, is ignored
+	const size_t blockRecords = 4096;
+	TraceRecord block[blockRecords];
+	uint64_t printed = 0;
+
+	while (printed < count && file)
+	{
+		file.read(reinterpret_cast<char*>(block), sizeof(block));
+		size_t records = static_cast<size_t>(file.gcount()) / sizeof(TraceRecord);
+
+		for (size_t r = 0; r < records && printed < count; ++r)
+		{
+			TraceRecord const& record = block[r];
+
+			if (record.cycle < from)
+			{
+				continue;
+			}
+
+			std::cout << std::dec << record.cycle << std::hex << " " << std::setw(3) << record.pc << " " << std::setw(4) << record.opcode << " i="
+				<< std::setw(3) << record.index;
+
+			if (!(record.changed & TRACE_NONE))
+			{
+				std::cout << " v" << (record.changed & TRACE_REGISTER_MASK) << "=" << std::setw(2) << unsigned(record.value);
+
+				if (record.changed & TRACE_ALSO_VF)
+				{
+					std::cout << " +vf";
+				}
+				if (record.changed & TRACE_MORE)
+				{
+					std::cout << " +more";
+				}
+			}
+
+			std::cout << "\n";
+			++printed;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,675 @@
+#include "VectorMachine.hpp"
+#include "Video.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHIP8_VECTOR_X86 1
+#include <immintrin.h>
+#endif
+
+// As in Video.cpp, the AVX2 paths are compiled per function so the rest of the
+// file still runs on CPUs without it
+#if defined(CHIP8_VECTOR_X86) && defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+	// Lanes per row are padded to a multiple of this, one AVX2 register of bytes
+	const unsigned int ROW_ALIGN = 32;
+
+	// The rows an opcode shared by every lane works on
+	struct Rows
+	{
+		uint8_t* V;
+		uint16_t* pc;
+		uint16_t* index;
+		uint8_t* delayTimer;
+		uint8_t* soundTimer;
+		unsigned int stride;
+
+		uint8_t* Register(unsigned int r) const { return V + r * stride; }
+	};
+
+	bool ExecuteRowsScalar(Rows const& rows, uint16_t opcode)
+	{
+		uint8_t* Vx = rows.Register((opcode & 0x0F00u) >> 8u);
+		uint8_t* Vy = rows.Register((opcode & 0x00F0u) >> 4u);
+		uint8_t* VF = rows.Register(0xF);
+		uint8_t kk = opcode & 0x00FFu;
+		uint16_t nnn = opcode & 0x0FFFu;
+		unsigned int count = rows.stride;
+
+		switch ((opcode & 0xF000u) >> 12u)
+		{
+			case 0x1: std::fill(rows.pc, rows.pc + count, nnn); return true;
+			case 0x3: for (unsigned int l = 0; l < count; ++l) rows.pc[l] += Vx[l] == kk ? 2 : 0; return true;
+			case 0x4: for (unsigned int l = 0; l < count; ++l) rows.pc[l] += Vx[l] != kk ? 2 : 0; return true;
+			case 0x5: for (unsigned int l = 0; l < count; ++l) rows.pc[l] += Vx[l] == Vy[l] ? 2 : 0; return true;
+			case 0x6: memset(Vx, kk, count); return true;
+			case 0x7: for (unsigned int l = 0; l < count; ++l) Vx[l] += kk; return true;
+			case 0x9: for (unsigned int l = 0; l < count; ++l) rows.pc[l] += Vx[l] != Vy[l] ? 2 : 0; return true;
+			case 0xA: std::fill(rows.index, rows.index + count, nnn); return true;
+
+			case 0x8:
+				// Same order of reads and writes as the OP_8xy* handlers, so VF as an operand behaves the same
+				switch (opcode & 0x000Fu)
+				{
+					case 0x0: memmove(Vx, Vy, count); return true;
+					case 0x1: for (unsigned int l = 0; l < count; ++l) Vx[l] |= Vy[l]; return true;
+					case 0x2: for (unsigned int l = 0; l < count; ++l) Vx[l] &= Vy[l]; return true;
+					case 0x3: for (unsigned int l = 0; l < count; ++l) Vx[l] ^= Vy[l]; return true;
+					case 0x4:
+						for (unsigned int l = 0; l < count; ++l)
+						{
+							unsigned int sum = Vx[l] + Vy[l];
+							VF[l] = sum > 255U ? 1 : 0;
+							Vx[l] = sum & 0xFFu;
+						}
+						return true;
+					case 0x5:
+						for (unsigned int l = 0; l < count; ++l)
+						{
+							VF[l] = Vx[l] > Vy[l] ? 1 : 0;
+							Vx[l] -= Vy[l];
+						}
+						return true;
+					case 0x6:
+						for (unsigned int l = 0; l < count; ++l)
+						{
+							VF[l] = Vx[l] & 0x1u;
+							Vx[l] >>= 1;
+						}
+						return true;
+					case 0x7:
+						for (unsigned int l = 0; l < count; ++l)
+						{
+							VF[l] = Vy[l] > Vx[l] ? 1 : 0;
+							Vx[l] = Vy[l] - Vx[l];
+						}
+						return true;
+					case 0xE:
+						for (unsigned int l = 0; l < count; ++l)
+						{
+							VF[l] = (Vx[l] & 0x80u) >> 7u;
+							Vx[l] <<= 1;
+						}
+						return true;
+					default: return false;
+				}
+
+			case 0xF:
+				switch (kk)
+				{
+					case 0x07: memcpy(Vx, rows.delayTimer, count); return true;
+					case 0x15: memcpy(rows.delayTimer, Vx, count); return true;
+					case 0x18: memcpy(rows.soundTimer, Vx, count); return true;
+					case 0x1E: for (unsigned int l = 0; l < count; ++l) rows.index[l] += Vx[l]; return true;
+					case 0x29: for (unsigned int l = 0; l < count; ++l) rows.index[l] = FONTSET_START_ADDRESS + 5 * Vx[l]; return true;
+					default: return false;
+				}
+
+			default:
+				return false;
+		}
+	}
+
+#if defined(CHIP8_VECTOR_X86)
+	// Adds 2 to the PC of every lane whose byte in skip is all ones
+	TARGET_AVX2 inline void SkipAVX2(uint16_t* pc, __m256i skip)
+	{
+		const __m256i two = _mm256_set1_epi16(2);
+
+		__m256i low = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(skip)), two);
+		__m256i high = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(skip, 1)), two);
+
+		__m256i* pcLow = reinterpret_cast<__m256i*>(pc);
+		__m256i* pcHigh = reinterpret_cast<__m256i*>(pc + 16);
+		_mm256_storeu_si256(pcLow, _mm256_add_epi16(_mm256_loadu_si256(pcLow), low));
+		_mm256_storeu_si256(pcHigh, _mm256_add_epi16(_mm256_loadu_si256(pcHigh), high));
+	}
+
+	TARGET_AVX2 inline __m256i Load(uint8_t const* row)
+	{
+		return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(row));
+	}
+
+	TARGET_AVX2 inline void Store(uint8_t* row, __m256i value)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(row), value);
+	}
+
+	// 32 lanes per step; every row is a whole number of steps long
+	TARGET_AVX2 bool ExecuteRowsAVX2(Rows const& rows, uint16_t opcode)
+	{
+		uint8_t* Vx = rows.Register((opcode & 0x0F00u) >> 8u);
+		uint8_t* Vy = rows.Register((opcode & 0x00F0u) >> 4u);
+		uint8_t* VF = rows.Register(0xF);
+		uint8_t kk = opcode & 0x00FFu;
+		unsigned int count = rows.stride;
+
+		const __m256i ones = _mm256_set1_epi8(-1);
+		const __m256i one = _mm256_set1_epi8(1);
+		const __m256i byte = _mm256_set1_epi8(static_cast<char>(kk));
+
+		switch ((opcode & 0xF000u) >> 12u)
+		{
+			case 0x3:
+				for (unsigned int l = 0; l < count; l += 32) SkipAVX2(rows.pc + l, _mm256_cmpeq_epi8(Load(Vx + l), byte));
+				return true;
+			case 0x4:
+				for (unsigned int l = 0; l < count; l += 32) SkipAVX2(rows.pc + l, _mm256_xor_si256(_mm256_cmpeq_epi8(Load(Vx + l), byte), ones));
+				return true;
+			case 0x5:
+				for (unsigned int l = 0; l < count; l += 32) SkipAVX2(rows.pc + l, _mm256_cmpeq_epi8(Load(Vx + l), Load(Vy + l)));
+				return true;
+			case 0x7:
+				for (unsigned int l = 0; l < count; l += 32) Store(Vx + l, _mm256_add_epi8(Load(Vx + l), byte));
+				return true;
+			case 0x9:
+				for (unsigned int l = 0; l < count; l += 32) SkipAVX2(rows.pc + l, _mm256_xor_si256(_mm256_cmpeq_epi8(Load(Vx + l), Load(Vy + l)), ones));
+				return true;
+
+			case 0x8:
+				// Each step stores VF before reloading the operands, as the OP_8xy* handlers do
+				switch (opcode & 0x000Fu)
+				{
+					case 0x1:
+						for (unsigned int l = 0; l < count; l += 32) Store(Vx + l, _mm256_or_si256(Load(Vx + l), Load(Vy + l)));
+						return true;
+					case 0x2:
+						for (unsigned int l = 0; l < count; l += 32) Store(Vx + l, _mm256_and_si256(Load(Vx + l), Load(Vy + l)));
+						return true;
+					case 0x3:
+						for (unsigned int l = 0; l < count; l += 32) Store(Vx + l, _mm256_xor_si256(Load(Vx + l), Load(Vy + l)));
+						return true;
+					case 0x4:
+						for (unsigned int l = 0; l < count; l += 32)
+						{
+							// The wrapping and saturating sums differ exactly where the add carried
+							__m256i a = Load(Vx + l);
+							__m256i b = Load(Vy + l);
+							__m256i sum = _mm256_add_epi8(a, b);
+							Store(VF + l, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(a, b), sum), one));
+							Store(Vx + l, sum);
+						}
+						return true;
+					case 0x5:
+						for (unsigned int l = 0; l < count; l += 32)
+						{
+							// Vx > Vy unless min(Vx, Vy) == Vx
+							__m256i a = Load(Vx + l);
+							Store(VF + l, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(a, Load(Vy + l)), a), one));
+							Store(Vx + l, _mm256_sub_epi8(Load(Vx + l), Load(Vy + l)));
+						}
+						return true;
+					case 0x6:
+						for (unsigned int l = 0; l < count; l += 32)
+						{
+							Store(VF + l, _mm256_and_si256(Load(Vx + l), one));
+							Store(Vx + l, _mm256_and_si256(_mm256_srli_epi16(Load(Vx + l), 1), _mm256_set1_epi8(0x7F)));
+						}
+						return true;
+					case 0x7:
+						for (unsigned int l = 0; l < count; l += 32)
+						{
+							__m256i b = Load(Vy + l);
+							Store(VF + l, _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(Load(Vx + l), b), b), one));
+							Store(Vx + l, _mm256_sub_epi8(Load(Vy + l), Load(Vx + l)));
+						}
+						return true;
+					case 0xE:
+						for (unsigned int l = 0; l < count; l += 32)
+						{
+							Store(VF + l, _mm256_and_si256(_mm256_srli_epi16(Load(Vx + l), 7), one));
+							__m256i a = Load(Vx + l);
+							Store(Vx + l, _mm256_add_epi8(a, a));
+						}
+						return true;
+					default:
+						return ExecuteRowsScalar(rows, opcode);
+				}
+
+			case 0xF:
+				switch (kk)
+				{
+					case 0x1E:
+						for (unsigned int l = 0; l < count; l += 16)
+						{
+							__m256i* I = reinterpret_cast<__m256i*>(rows.index + l);
+							__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(Vx + l)));
+							_mm256_storeu_si256(I, _mm256_add_epi16(_mm256_loadu_si256(I), v));
+						}
+						return true;
+					case 0x29:
+						for (unsigned int l = 0; l < count; l += 16)
+						{
+							__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(Vx + l)));
+							__m256i address = _mm256_add_epi16(_mm256_mullo_epi16(v, _mm256_set1_epi16(5)), _mm256_set1_epi16(FONTSET_START_ADDRESS));
+							_mm256_storeu_si256(reinterpret_cast<__m256i*>(rows.index + l), address);
+						}
+						return true;
+					default:
+						return ExecuteRowsScalar(rows, opcode);
+				}
+
+			default:
+				// Fills and copies are already memset/memcpy
+				return ExecuteRowsScalar(rows, opcode);
+		}
+	}
+
+	TARGET_AVX2 bool SamePCAVX2(uint16_t const* pc, unsigned int count)
+	{
+		const __m256i first = _mm256_set1_epi16(static_cast<short>(pc[0]));
+		unsigned int l = 0;
+
+		for (; l + 16 <= count; l += 16)
+		{
+			__m256i lanes = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pc + l));
+
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(lanes, first)) != -1)
+			{
+				return false;
+			}
+		}
+
+		for (; l < count; ++l)
+		{
+			if (pc[l] != pc[0])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+#endif
+
+	bool SamePCScalar(uint16_t const* pc, unsigned int count)
+	{
+		for (unsigned int l = 1; l < count; ++l)
+		{
+			if (pc[l] != pc[0])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool WritesMemory(uint16_t opcode)
+	{
+		return (opcode & 0xF0FFu) == 0xF033u || (opcode & 0xF0FFu) == 0xF055u;
+	}
+}
+
+VectorMachine::VectorMachine(unsigned int laneCount, uint64_t seed)
+	: laneCount(laneCount > 0 ? laneCount : 1)
+{
+	stride = (this->laneCount + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+	avx2 = CpuHasAVX2();
+
+	V.assign(REGISTER_COUNT * stride, 0);
+	pc.assign(stride, START_ADDRESS);
+	index.assign(stride, 0);
+	sp.assign(stride, 0);
+	delayTimer.assign(stride, 0);
+	soundTimer.assign(stride, 0);
+	stack.assign(STACK_LEVELS * stride, 0);
+	keypad.assign(KEY_COUNT * stride, 0);
+
+	memory.assign(this->laneCount * MEMORY_SIZE, 0);
+	video.assign(this->laneCount * VIDEO_HEIGHT, 0);
+
+	for (unsigned int lane = 0; lane < this->laneCount; ++lane)
+	{
+		memcpy(&memory[lane * MEMORY_SIZE + FONTSET_START_ADDRESS], fontset, FONTSET_SIZE);
+		random.emplace_back();
+		random.back().Seed(RandomSource::Pcg, seed + lane);
+	}
+}
+
+bool VectorMachine::LoadROM(char const* filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::streamsize size = std::min<std::streamsize>(file.tellg(), MEMORY_SIZE - START_ADDRESS);
+	std::vector<char> buffer(size);
+
+	file.seekg(0, std::ios::beg);
+	file.read(buffer.data(), size);
+
+	for (unsigned int lane = 0; lane < laneCount; ++lane)
+	{
+		memcpy(&memory[lane * MEMORY_SIZE + START_ADDRESS], buffer.data(), size);
+	}
+
+	memoryShared = true;
+
+	return true;
+}
+
+void VectorMachine::SetClockHz(uint32_t clockHz)
+{
+	scheduler.SetClockHz(clockHz);
+}
+
+void VectorMachine::SetKey(unsigned int lane, unsigned int key, bool pressed)
+{
+	keypad[(key & (KEY_COUNT - 1u)) * stride + lane] = pressed ? 1 : 0;
+}
+
+uint16_t VectorMachine::FetchOpcode(unsigned int lane, uint16_t address) const
+{
+	uint8_t const* laneMemory = &memory[lane * MEMORY_SIZE];
+
+	return (laneMemory[address & (MEMORY_SIZE - 1u)] << 8u) | laneMemory[(address + 1u) & (MEMORY_SIZE - 1u)];
+}
+
+bool VectorMachine::LanesUniform() const
+{
+#if defined(CHIP8_VECTOR_X86)
+	bool samePC = avx2 ? SamePCAVX2(pc.data(), laneCount) : SamePCScalar(pc.data(), laneCount);
+#else
+	bool samePC = SamePCScalar(pc.data(), laneCount);
+#endif
+
+	if (!samePC)
+	{
+		return false;
+	}
+
+	if (memoryShared)
+	{
+		return true;
+	}
+
+	uint16_t opcode = FetchOpcode(0, pc[0]);
+
+	for (unsigned int lane = 1; lane < laneCount; ++lane)
+	{
+		if (FetchOpcode(lane, pc[0]) != opcode)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool VectorMachine::ExecuteRows(uint16_t opcode)
+{
+	Rows rows = { V.data(), pc.data(), index.data(), delayTimer.data(), soundTimer.data(), stride };
+
+#if defined(CHIP8_VECTOR_X86)
+	if (avx2)
+	{
+		return ExecuteRowsAVX2(rows, opcode);
+	}
+#endif
+
+	return ExecuteRowsScalar(rows, opcode);
+}
+
+uint8_t VectorMachine::DrawSprite(unsigned int lane, uint16_t address, uint8_t x, uint8_t y, uint8_t height)
+{
+	uint8_t const* laneMemory = &memory[lane * MEMORY_SIZE];
+	uint64_t* laneVideo = &video[lane * VIDEO_HEIGHT];
+	uint8_t xPos = x % VIDEO_WIDTH;
+	uint8_t yPos = y % VIDEO_HEIGHT;
+
+	uint64_t collision = 0;
+
+	for (unsigned int row = 0; row < height && yPos + row < VIDEO_HEIGHT; ++row)
+	{
+		uint64_t spriteRow = (uint64_t(laneMemory[(address + row) & (MEMORY_SIZE - 1u)]) << 56u) >> xPos;
+
+		collision |= laneVideo[yPos + row] & spriteRow;
+		laneVideo[yPos + row] ^= spriteRow;
+	}
+
+	return collision ? 1 : 0;
+}
+
+// One instruction of one lane, with the PC already advanced past it; the same
+// instruction set as Chip8::RunSwitch
+void VectorMachine::ExecuteLane(unsigned int lane, uint16_t opcode)
+{
+	uint8_t* laneMemory = &memory[lane * MEMORY_SIZE];
+	auto R = [&](unsigned int r) -> uint8_t& { return V[r * stride + lane]; };
+
+	uint8_t x = (opcode & 0x0F00u) >> 8u;
+	uint8_t y = (opcode & 0x00F0u) >> 4u;
+	uint8_t kk = opcode & 0x00FFu;
+	uint16_t nnn = opcode & 0x0FFFu;
+	uint16_t& PC = pc[lane];
+	uint16_t& I = index[lane];
+	uint8_t& SP = sp[lane];
+
+	switch ((opcode & 0xF000u) >> 12u)
+	{
+		case 0x0:
+			switch (opcode & 0x000Fu)
+			{
+				case 0x0: memset(&video[lane * VIDEO_HEIGHT], 0, VIDEO_HEIGHT * sizeof(uint64_t)); break;
+				case 0xE: SP = (SP - 1u) & (STACK_LEVELS - 1u); PC = stack[SP * stride + lane]; break;
+				default: break;
+			}
+			break;
+
+		case 0x1: PC = nnn; break;
+		case 0x2: stack[SP * stride + lane] = PC; SP = (SP + 1u) & (STACK_LEVELS - 1u); PC = nnn; break;
+		case 0x3: if (R(x) == kk) PC += 2; break;
+		case 0x4: if (R(x) != kk) PC += 2; break;
+		case 0x5: if (R(x) == R(y)) PC += 2; break;
+		case 0x6: R(x) = kk; break;
+		case 0x7: R(x) += kk; break;
+
+		case 0x8:
+			switch (opcode & 0x000Fu)
+			{
+				case 0x0: R(x) = R(y); break;
+				case 0x1: R(x) |= R(y); break;
+				case 0x2: R(x) &= R(y); break;
+				case 0x3: R(x) ^= R(y); break;
+				case 0x4:{
+					uint16_t sum = R(x) + R(y);
+					R(0xF) = sum > 255U ? 1 : 0;
+					R(x) = sum & 0xFFu;
+				} break;
+				case 0x5:
+					R(0xF) = R(x) > R(y) ? 1 : 0;
+					R(x) -= R(y);
+					break;
+				case 0x6:
+					R(0xF) = R(x) & 0x1u;
+					R(x) >>= 1;
+					break;
+				case 0x7:
+					R(0xF) = R(y) > R(x) ? 1 : 0;
+					R(x) = R(y) - R(x);
+					break;
+				case 0xE:
+					R(0xF) = (R(x) & 0x80u) >> 7u;
+					R(x) <<= 1;
+					break;
+				default: break;
+			}
+			break;
+
+		case 0x9: if (R(x) != R(y)) PC += 2; break;
+		case 0xA: I = nnn; break;
+		case 0xB: PC = R(0) + nnn; break;
+		case 0xC: R(x) = random[lane].Next() & kk; break;
+		case 0xD: R(0xF) = DrawSprite(lane, I, R(x), R(y), opcode & 0x000Fu); break;
+
+		case 0xE:
+			switch (opcode & 0x000Fu)
+			{
+				case 0xE: if (keypad[(R(x) & (KEY_COUNT - 1u)) * stride + lane]) PC += 2; break;
+				case 0x1: if (!keypad[(R(x) & (KEY_COUNT - 1u)) * stride + lane]) PC += 2; break;
+				default: break;
+			}
+			break;
+
+		case 0xF:
+			switch (kk)
+			{
+				case 0x07: R(x) = delayTimer[lane]; break;
+				case 0x0A:{
+					// Lowest pressed key wins, as in Chip8::OP_Fx0A
+					unsigned int key = 0;
+					while (key < KEY_COUNT && !keypad[key * stride + lane])
+					{
+						++key;
+					}
+
+					if (key == KEY_COUNT)
+					{
+						PC -= 2;
+					}
+					else
+					{
+						R(x) = key;
+					}
+				} break;
+				case 0x15: delayTimer[lane] = R(x); break;
+				case 0x18: soundTimer[lane] = R(x); break;
+				case 0x1E: I += R(x); break;
+				case 0x29: I = FONTSET_START_ADDRESS + (5 * R(x)); break;
+				case 0x33:
+					laneMemory[(I + 2) & (MEMORY_SIZE - 1u)] = R(x) % 10;
+					laneMemory[(I + 1) & (MEMORY_SIZE - 1u)] = (R(x) / 10) % 10;
+					laneMemory[I & (MEMORY_SIZE - 1u)] = (R(x) / 100) % 10;
+					break;
+				case 0x55:
+					for (uint8_t i = 0; i <= x; ++i)
+					{
+						laneMemory[(I + i) & (MEMORY_SIZE - 1u)] = R(i);
+					}
+					break;
+				case 0x65:
+					for (uint8_t i = 0; i <= x; ++i)
+					{
+						R(i) = laneMemory[(I + i) & (MEMORY_SIZE - 1u)];
+					}
+					break;
+				default: break;
+			}
+			break;
+	}
+}
+
+void VectorMachine::TickTimers(unsigned int ticks)
+{
+	uint8_t step = static_cast<uint8_t>(std::min(ticks, 255U));
+
+	for (unsigned int l = 0; l < stride; ++l)
+	{
+		delayTimer[l] = delayTimer[l] > step ? delayTimer[l] - step : 0;
+		soundTimer[l] = soundTimer[l] > step ? soundTimer[l] - step : 0;
+	}
+}
+
+void VectorMachine::RunCycles(unsigned int n)
+{
+	for (unsigned int cycle = 0; cycle < n; ++cycle)
+	{
+		++stats.steps;
+
+		if (LanesUniform())
+		{
+			// One fetch and decode for every lane
+			uint16_t address = pc[0];
+			uint16_t opcode = FetchOpcode(0, address);
+
+			std::fill(pc.begin(), pc.end(), static_cast<uint16_t>(address + 2));
+
+			++stats.uniformSteps;
+			wasUniform = true;
+
+			if (ExecuteRows(opcode))
+			{
+				++stats.vectorSteps;
+			}
+			else
+			{
+				for (unsigned int lane = 0; lane < laneCount; ++lane)
+				{
+					ExecuteLane(lane, opcode);
+				}
+
+				// Lanes storing the same bytes at the same address keep memory shared
+				if (memoryShared && WritesMemory(opcode))
+				{
+					uint16_t I = index[0];
+					unsigned int length = (opcode & 0x00FFu) == 0x33u ? 3u : ((opcode & 0x0F00u) >> 8u) + 1u;
+
+					for (unsigned int lane = 1; lane < laneCount && memoryShared; ++lane)
+					{
+						for (unsigned int i = 0; i < length; ++i)
+						{
+							uint16_t address = (I + i) & (MEMORY_SIZE - 1u);
+
+							if (index[lane] != I || memory[lane * MEMORY_SIZE + address] != memory[address])
+							{
+								memoryShared = false;
+								break;
+							}
+						}
+					}
+				}
+			}
+		}
+		else
+		{
+			++stats.divergentSteps;
+
+			if (wasUniform)
+			{
+				++stats.divergences;
+				wasUniform = false;
+			}
+
+			for (unsigned int lane = 0; lane < laneCount; ++lane)
+			{
+				uint16_t opcode = FetchOpcode(lane, pc[lane]);
+				pc[lane] += 2;
+
+				ExecuteLane(lane, opcode);
+
+				if (WritesMemory(opcode))
+				{
+					memoryShared = false;
+				}
+			}
+		}
+
+		unsigned int ticks = scheduler.Advance(1);
+
+		if (ticks)
+		{
+			TickTimers(ticks);
+		}
+	}
+}
+
+void VectorMachine::Report(std::ostream& out) const
+{
+	double steps = stats.steps ? static_cast<double>(stats.steps) : 1.0;
+
+	out << "lanes " << laneCount << ", steps " << stats.steps << ", uniform " << 100.0 * stats.uniformSteps / steps << "%, vector "
+		<< 100.0 * stats.vectorSteps / steps << "%, divergent " << 100.0 * stats.divergentSteps / steps << "%, divergences "
+		<< stats.divergences << (avx2 ? ", avx2" : ", scalar rows") << "\n";
+}
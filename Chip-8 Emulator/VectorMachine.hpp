@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "Chip8.hpp"
+
+// Many CHIP-8 machines running the same ROM in lockstep, stored structure-of-arrays:
+// register r of every lane is one contiguous row, as are the PCs, index registers
+// and timers. While every lane sits at the same PC with the same opcode the
+// instruction runs once across whole rows (32 lanes per AVX2 operation); once the
+// lanes diverge each one is stepped on its own until they meet again. Lanes share
+// the clock, so their timers tick together; they differ only by their keypads,
+// their random numbers and whatever follows from those. Lanes implement
+// QuirkProfile::Default only.
+class VectorMachine
+{
+public:
+	// Lane l draws its random bytes from RandomSource::Pcg seeded with seed + l,
+	// the same sequence a Chip8 given that seed would see
+	explicit VectorMachine(unsigned int laneCount, uint64_t seed = 0);
+
+	bool LoadROM(char const* filename);
+	void SetClockHz(uint32_t clockHz);
+	// Runs n cycles on every lane
+	void RunCycles(unsigned int n);
+
+	void SetKey(unsigned int lane, unsigned int key, bool pressed);
+
+	unsigned int Lanes() const { return laneCount; }
+	uint8_t Register(unsigned int lane, unsigned int r) const { return V[r * stride + lane]; }
+	uint16_t PC(unsigned int lane) const { return pc[lane]; }
+	uint16_t Index(unsigned int lane) const { return index[lane]; }
+	uint8_t SP(unsigned int lane) const { return sp[lane]; }
+	uint8_t DelayTimer(unsigned int lane) const { return delayTimer[lane]; }
+	uint8_t SoundTimer(unsigned int lane) const { return soundTimer[lane]; }
+	uint64_t const* Video(unsigned int lane) const { return &video[lane * VIDEO_HEIGHT]; }
+	Scheduler const& GetScheduler() const { return scheduler; }
+
+	// How the lockstep cycles were executed
+	struct Stats
+	{
+		uint64_t steps;// cycles run, each covering every lane
+		uint64_t uniformSteps;// all lanes at the same PC and opcode
+		uint64_t vectorSteps;// uniform steps executed as whole-row operations
+		uint64_t divergentSteps;// lanes at different PCs or opcodes, stepped one by one
+		uint64_t divergences;// uniform steps followed by a divergent one
+	};
+
+	Stats const& GetStats() const { return stats; }
+	void Report(std::ostream& out) const;
+	// Whether whole-row operations use AVX2 on this CPU
+	bool UsesAVX2() const { return avx2; }
+
+private:
+	bool LanesUniform() const;
+	// Whole-row execution of an opcode every lane runs; false if it has to go lane by lane
+	bool ExecuteRows(uint16_t opcode);
+	void ExecuteLane(unsigned int lane, uint16_t opcode);
+	uint16_t FetchOpcode(unsigned int lane, uint16_t address) const;
+	uint8_t DrawSprite(unsigned int lane, uint16_t address, uint8_t x, uint8_t y, uint8_t height);
+	void TickTimers(unsigned int ticks);
+
+	unsigned int laneCount;
+	unsigned int stride;// lanes per row, rounded up to a whole number of SIMD registers
+	bool avx2;
+
+	// Rows of stride lanes; register r of lane l is V[r * stride + l]
+	std::vector<uint8_t> V;
+	std::vector<uint16_t> pc;
+	std::vector<uint16_t> index;
+	std::vector<uint8_t> sp;
+	std::vector<uint8_t> delayTimer;
+	std::vector<uint8_t> soundTimer;
+	std::vector<uint16_t> stack;// level s of lane l is stack[s * stride + l]
+	std::vector<uint8_t> keypad;// key k of lane l is keypad[k * stride + l]
+
+	// Per lane blocks
+	std::vector<uint8_t> memory;// MEMORY_SIZE bytes per lane
+	std::vector<uint64_t> video;// VIDEO_HEIGHT rows per lane
+	std::vector<RandomByte> random;
+
+	// True while no lane has written memory differently from the others,
+	// so the opcode at a shared PC can be read from lane 0 alone
+	bool memoryShared{true};
+	bool wasUniform{true};
+
+	Scheduler scheduler;
+	Stats stats{};
+};
@@ -0,0 +1,461 @@
+#include "Video.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHIP8_VIDEO_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the instruction set enabled per function so the rest of the
+// file still runs on CPUs without it; MSVC allows the intrinsics anywhere
+#if defined(CHIP8_VIDEO_X86) && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+	const int MAX_WIDTH = 128;
+
+	inline unsigned int Pixel(uint64_t const* row, int x)
+	{
+		return (row[x >> 6] >> (63 - (x & 63))) & 1u;
+	}
+
+	// Repeats the finished first line of a scaled row into the scale - 1 lines below it
+	void ReplicateLines(uint32_t* line, int width, int scale, int pitch)
+	{
+		for (int i = 1; i < scale; ++i)
+		{
+			memcpy(reinterpret_cast<uint8_t*>(line) + i * pitch, line, width * sizeof(uint32_t));
+		}
+	}
+
+	inline unsigned int PlanePixel(uint64_t const* row0, uint64_t const* row1, int x)
+	{
+		return Pixel(row0, x) | (Pixel(row1, x) << 1);
+	}
+
+	void WidenScalar(uint32_t const* source, int width, int scale, uint32_t* line)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			for (int i = 0; i < scale; ++i)
+			{
+				*line++ = source[x];
+			}
+		}
+	}
+
+	void ExpandScalar(uint64_t const* rows, int wordsPerRow, int width, int height, uint32_t const palette[2], int scale, uint32_t* dst, int pitch)
+	{
+		uint32_t source[MAX_WIDTH];
+
+		for (int y = 0; y < height; ++y)
+		{
+			uint64_t const* row = rows + y * wordsPerRow;
+			uint32_t* line = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(dst) + y * scale * pitch);
+			uint32_t* expanded = scale == 1 ? line : source;
+
+			for (int x = 0; x < width; ++x)
+			{
+				expanded[x] = palette[Pixel(row, x)];
+			}
+
+			if (scale > 1)
+			{
+				WidenScalar(source, width, scale, line);
+				ReplicateLines(line, width * scale, scale, pitch);
+			}
+		}
+	}
+
+	void CompositeScalar(uint64_t const* plane0, uint64_t const* plane1, int wordsPerRow, int width, int height, uint32_t const palette[4], int scale,
+		uint32_t* dst, int pitch)
+	{
+		uint32_t source[MAX_WIDTH];
+
+		for (int y = 0; y < height; ++y)
+		{
+			uint64_t const* row0 = plane0 + y * wordsPerRow;
+			uint64_t const* row1 = plane1 + y * wordsPerRow;
+			uint32_t* line = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(dst) + y * scale * pitch);
+			uint32_t* expanded = scale == 1 ? line : source;
+
+			for (int x = 0; x < width; ++x)
+			{
+				expanded[x] = palette[PlanePixel(row0, row1, x)];
+			}
+
+			if (scale > 1)
+			{
+				WidenScalar(source, width, scale, line);
+				ReplicateLines(line, width * scale, scale, pitch);
+			}
+		}
+	}
+
+#if defined(CHIP8_VIDEO_X86)
+	// Four pixels per step: broadcast the row's next four bits to every lane, keep
+	// the lane's own bit and turn the result into an all-ones or all-zeros select mask
+	TARGET_SSE2 void ExpandRowSSE2(uint64_t const* row, int width, uint32_t const palette[2], uint32_t* out)
+	{
+		const __m128i laneBits = _mm_set_epi32(1, 2, 4, 8);
+		const __m128i off = _mm_set1_epi32(static_cast<int>(palette[0]));
+		const __m128i on = _mm_set1_epi32(static_cast<int>(palette[1]));
+
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			unsigned int bits = static_cast<unsigned int>(row[x >> 6] >> (60 - (x & 63))) & 0xFu;
+			__m128i mask = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), laneBits), laneBits);
+			__m128i pixels = _mm_or_si128(_mm_and_si128(mask, on), _mm_andnot_si128(mask, off));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), pixels);
+		}
+
+		for (; x < width; ++x)
+		{
+			out[x] = palette[Pixel(row, x)];
+		}
+	}
+
+	TARGET_SSE2 inline __m128i SelectSSE2(__m128i mask, __m128i on, __m128i off)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, on), _mm_andnot_si128(mask, off));
+	}
+
+	// Two select masks per step, one per plane: plane 0 picks between the colours
+	// with plane 1 off and those with it on, and plane 1 picks between the two
+	TARGET_SSE2 void CompositeRowSSE2(uint64_t const* row0, uint64_t const* row1, int width, uint32_t const palette[4], uint32_t* out)
+	{
+		const __m128i laneBits = _mm_set_epi32(1, 2, 4, 8);
+		const __m128i colour0 = _mm_set1_epi32(static_cast<int>(palette[0]));
+		const __m128i colour1 = _mm_set1_epi32(static_cast<int>(palette[1]));
+		const __m128i colour2 = _mm_set1_epi32(static_cast<int>(palette[2]));
+		const __m128i colour3 = _mm_set1_epi32(static_cast<int>(palette[3]));
+
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			unsigned int bits0 = static_cast<unsigned int>(row0[x >> 6] >> (60 - (x & 63))) & 0xFu;
+			unsigned int bits1 = static_cast<unsigned int>(row1[x >> 6] >> (60 - (x & 63))) & 0xFu;
+			__m128i mask0 = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits0), laneBits), laneBits);
+			__m128i mask1 = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits1), laneBits), laneBits);
+			__m128i low = SelectSSE2(mask0, colour1, colour0);
+			__m128i high = SelectSSE2(mask0, colour3, colour2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), SelectSSE2(mask1, high, low));
+		}
+
+		for (; x < width; ++x)
+		{
+			out[x] = palette[PlanePixel(row0, row1, x)];
+		}
+	}
+
+	TARGET_SSE2 void WidenSSE2(uint32_t const* source, int width, int scale, uint32_t* line)
+	{
+		if (scale == 2)
+		{
+			int x = 0;
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(line + 2 * x), _mm_unpacklo_epi32(pixels, pixels));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(line + 2 * x + 4), _mm_unpackhi_epi32(pixels, pixels));
+			}
+			WidenScalar(source + x, width - x, scale, line + 2 * x);
+		}
+		else if (scale % 4 == 0)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				__m128i pixel = _mm_set1_epi32(static_cast<int>(source[x]));
+				for (int i = 0; i < scale; i += 4)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(line + x * scale + i), pixel);
+				}
+			}
+		}
+		else
+		{
+			WidenScalar(source, width, scale, line);
+		}
+	}
+
+	TARGET_SSE2 void ExpandSSE2(uint64_t const* rows, int wordsPerRow, int width, int height, uint32_t const palette[2], int scale, uint32_t* dst, int pitch)
+	{
+		uint32_t source[MAX_WIDTH];
+
+		for (int y = 0; y < height; ++y)
+		{
+			uint32_t* line = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(dst) + y * scale * pitch);
+
+			ExpandRowSSE2(rows + y * wordsPerRow, width, palette, scale == 1 ? line : source);
+
+			if (scale > 1)
+			{
+				WidenSSE2(source, width, scale, line);
+				ReplicateLines(line, width * scale, scale, pitch);
+			}
+		}
+	}
+
+	TARGET_SSE2 void CompositeSSE2(uint64_t const* plane0, uint64_t const* plane1, int wordsPerRow, int width, int height, uint32_t const palette[4],
+		int scale, uint32_t* dst, int pitch)
+	{
+		uint32_t source[MAX_WIDTH];
+
+		for (int y = 0; y < height; ++y)
+		{
+			uint32_t* line = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(dst) + y * scale * pitch);
+
+			CompositeRowSSE2(plane0 + y * wordsPerRow, plane1 + y * wordsPerRow, width, palette, scale == 1 ? line : source);
+
+			if (scale > 1)
+			{
+				WidenSSE2(source, width, scale, line);
+				ReplicateLines(line, width * scale, scale, pitch);
+			}
+		}
+	}
+
+	// The same select as the SSE2 kernel, eight pixels per step
+	TARGET_AVX2 void ExpandRowAVX2(uint64_t const* row, int width, uint32_t const palette[2], uint32_t* out)
+	{
+		const __m256i laneBits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		const __m256i off = _mm256_set1_epi32(static_cast<int>(palette[0]));
+		const __m256i on = _mm256_set1_epi32(static_cast<int>(palette[1]));
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			unsigned int bits = static_cast<unsigned int>(row[x >> 6] >> (56 - (x & 63))) & 0xFFu;
+			__m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), laneBits), laneBits);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_blendv_epi8(off, on, mask));
+		}
+
+		for (; x < width; ++x)
+		{
+			out[x] = palette[Pixel(row, x)];
+		}
+	}
+
+	TARGET_AVX2 void CompositeRowAVX2(uint64_t const* row0, uint64_t const* row1, int width, uint32_t const palette[4], uint32_t* out)
+	{
+		const __m256i laneBits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		const __m256i colour0 = _mm256_set1_epi32(static_cast<int>(palette[0]));
+		const __m256i colour1 = _mm256_set1_epi32(static_cast<int>(palette[1]));
+		const __m256i colour2 = _mm256_set1_epi32(static_cast<int>(palette[2]));
+		const __m256i colour3 = _mm256_set1_epi32(static_cast<int>(palette[3]));
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			unsigned int bits0 = static_cast<unsigned int>(row0[x >> 6] >> (56 - (x & 63))) & 0xFFu;
+			unsigned int bits1 = static_cast<unsigned int>(row1[x >> 6] >> (56 - (x & 63))) & 0xFFu;
+			__m256i mask0 = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits0), laneBits), laneBits);
+			__m256i mask1 = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits1), laneBits), laneBits);
+			__m256i low = _mm256_blendv_epi8(colour0, colour1, mask0);
+			__m256i high = _mm256_blendv_epi8(colour2, colour3, mask0);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_blendv_epi8(low, high, mask1));
+		}
+
+		for (; x < width; ++x)
+		{
+			out[x] = palette[PlanePixel(row0, row1, x)];
+		}
+	}
+
+	TARGET_AVX2 void WidenAVX2(uint32_t const* source, int width, int scale, uint32_t* line)
+	{
+		if (scale == 2)
+		{
+			// Pixels 0-3 become 0,0,1,1,2,2,3,3 and pixels 4-7 become 4,4,...,7,7
+			const __m256i low = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+			const __m256i high = _mm256_set_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+
+			int x = 0;
+			for (; x + 8 <= width; x += 8)
+			{
+				__m256i pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(source + x));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(line + 2 * x), _mm256_permutevar8x32_epi32(pixels, low));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(line + 2 * x + 8), _mm256_permutevar8x32_epi32(pixels, high));
+			}
+			WidenScalar(source + x, width - x, scale, line + 2 * x);
+		}
+		else if (scale % 8 == 0)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				__m256i pixel = _mm256_set1_epi32(static_cast<int>(source[x]));
+				for (int i = 0; i < scale; i += 8)
+				{
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(line + x * scale + i), pixel);
+				}
+			}
+		}
+		else if (scale % 4 == 0)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				__m128i pixel = _mm_set1_epi32(static_cast<int>(source[x]));
+				for (int i = 0; i < scale; i += 4)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(line + x * scale + i), pixel);
+				}
+			}
+		}
+		else
+		{
+			WidenScalar(source, width, scale, line);
+		}
+	}
+
+	TARGET_AVX2 void ExpandAVX2(uint64_t const* rows, int wordsPerRow, int width, int height, uint32_t const palette[2], int scale, uint32_t* dst, int pitch)
+	{
+		uint32_t source[MAX_WIDTH];
+
+		for (int y = 0; y < height; ++y)
+		{
+			uint32_t* line = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(dst) + y * scale * pitch);
+
+			ExpandRowAVX2(rows + y * wordsPerRow, width, palette, scale == 1 ? line : source);
+
+			if (scale > 1)
+			{
+				WidenAVX2(source, width, scale, line);
+				ReplicateLines(line, width * scale, scale, pitch);
+			}
+		}
+	}
+
+	TARGET_AVX2 void CompositeAVX2(uint64_t const* plane0, uint64_t const* plane1, int wordsPerRow, int width, int height, uint32_t const palette[4],
+		int scale, uint32_t* dst, int pitch)
+	{
+		uint32_t source[MAX_WIDTH];
+
+		for (int y = 0; y < height; ++y)
+		{
+			uint32_t* line = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(dst) + y * scale * pitch);
+
+			CompositeRowAVX2(plane0 + y * wordsPerRow, plane1 + y * wordsPerRow, width, palette, scale == 1 ? line : source);
+
+			if (scale > 1)
+			{
+				WidenAVX2(source, width, scale, line);
+				ReplicateLines(line, width * scale, scale, pitch);
+			}
+		}
+	}
+
+	bool CpuHasSSE2()
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		return true;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+#else
+		return __builtin_cpu_supports("sse2");
+#endif
+	}
+#endif
+
+	const ExpandKernel scalarKernel = { "scalar", ExpandScalar, CompositeScalar };
+#if defined(CHIP8_VIDEO_X86)
+	const ExpandKernel sse2Kernel = { "sse2", ExpandSSE2, CompositeSSE2 };
+	const ExpandKernel avx2Kernel = { "avx2", ExpandAVX2, CompositeAVX2 };
+#endif
+}
+
+namespace
+{
+	struct KernelList
+	{
+		ExpandKernel kernels[3];
+		int count;
+	};
+
+	KernelList DetectKernels()
+	{
+		KernelList list{};
+		list.kernels[list.count++] = scalarKernel;
+#if defined(CHIP8_VIDEO_X86)
+		if (CpuHasSSE2())
+		{
+			list.kernels[list.count++] = sse2Kernel;
+		}
+		if (CpuHasAVX2())
+		{
+			list.kernels[list.count++] = avx2Kernel;
+		}
+#endif
+		return list;
+	}
+}
+
+bool CpuHasAVX2()
+{
+#if !defined(CHIP8_VIDEO_X86)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+
+	// The OS must also save the YMM registers on a context switch
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+int AvailableExpandKernels(ExpandKernel const** kernels)
+{
+	static const KernelList list = DetectKernels();
+
+	*kernels = list.kernels;
+	return list.count;
+}
+
+ExpandKernel const& BestExpandKernel()
+{
+	ExpandKernel const* kernels;
+	int count = AvailableExpandKernels(&kernels);
+
+	return kernels[count - 1];
+}
+
+uint64_t HashFrame(uint64_t const* rows, int wordCount, uint64_t seed)
+{
+	uint64_t hash = seed;
+
+	for (int i = 0; i < wordCount; ++i)
+	{
+		for (int shift = 56; shift >= 0; shift -= 8)
+		{
+			hash ^= (rows[i] >> shift) & 0xFFu;
+			hash *= 0x100000001B3ull;
+		}
+	}
+
+	return hash;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Conversion of the packed 1bpp framebuffer into RGBA8888 texture memory.
+//
+// Rows are wordsPerRow 64-bit words, column 0 in the most significant bit of the
+// first word. Each source pixel becomes a scale x scale block of palette[bit]
+// at dst, whose rows are pitch bytes apart. scale runs from 1 to MAX_SCALE.
+const int MAX_SCALE = 16;
+
+struct ExpandKernel
+{
+	char const* name;
+	void (*expand)(uint64_t const* rows, int wordsPerRow, int width, int height, uint32_t const palette[2], int scale, uint32_t* dst, int pitch);
+	// The same for XO-CHIP's two bitplanes: each pixel is palette[plane 0 bit + 2 * plane 1 bit]
+	void (*composite)(uint64_t const* plane0, uint64_t const* plane1, int wordsPerRow, int width, int height, uint32_t const palette[4], int scale,
+		uint32_t* dst, int pitch);
+};
+
+// Kernels usable on this CPU, best last; the scalar kernel is always first
+int AvailableExpandKernels(ExpandKernel const** kernels);
+// The fastest kernel usable on this CPU
+ExpandKernel const& BestExpandKernel();
+
+// Whether the CPU and OS support AVX2, for code that picks a SIMD path at run time
+bool CpuHasAVX2();
+
+// FNV-1a hash of a packed frame, for comparing runs without storing the frames;
+// passing the hash of one plane as the seed of the next hashes several in turn
+const uint64_t FRAME_HASH_SEED = 0xCBF29CE484222325ull;
+uint64_t HashFrame(uint64_t const* rows, int wordCount, uint64_t seed = FRAME_HASH_SEED);